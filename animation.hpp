@@ -0,0 +1,158 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include "noise.hpp"
+
+namespace pn {
+  /**
+   * Time animated fbm over a fixed 2D grid, fbm(x, y, time, zoom_factor) with time as the third coordinate.
+   *
+   * Octave o of fbm samples the noise at time / zoom_o, so the coarse octaves crawl through noise space and barely
+   * change between frames. Each octave gets a keyframe interval: its values are cached at the keyframe times around
+   * the current time and linearly interpolated in between, only octaves whose interval would be shorter than
+   * min_interval (typically the frame time step) are evaluated every frame.
+   *
+   * Error bound: linear interpolation over an interval h misses a function by at most h^2 / 8 * max|f''|. Octave o
+   * adds (zoom_o / zoom_factor) * noise(..., time / zoom_o), whose second time derivative is bounded by
+   * (zoom_o / zoom_factor) * C / zoom_o^2 with C the bound of the noise's second derivative. Every interpolated octave
+   * gets an equal share of max_error and its interval is the longest that keeps it within that share, so the sum
+   * differs from fbm by at most max_error (plus rounding), given C. C is the generator's second_derivative() unless
+   * passed in, proven for perlin::improved and perlin::Original; generators without one fall back to
+   * estimate_curvature, the largest sampled second difference with a safety margin, and the bound is then only an
+   * empirical one. Interpolating across a discontinuity misses by up to the jump however short the interval, so every
+   * octave of a generator with max_jump(3) > 0 is evaluated every frame.
+   *
+   * Keyframes are stored per row and refreshed lazily by evaluate(), so disjoint row ranges can be evaluated
+   * concurrently (e.g. on a pn::pool) and keyframe refreshes are spread over the same threads. Keyframe phases are
+   * staggered between octaves so their refreshes fall on different frames.
+   */
+  template<typename T>
+  class basic_animated_fbm {
+  public:
+    using grid2 = pn::basic_grid2<T>;
+    using grid3 = pn::basic_grid3<T>;
+
+    /**
+     * @param gen Noise generator, must outlive the field
+     * @param grid Points of the field
+     * @param zoom_factor Zoom factor of the fbm
+     * @param max_error Maximum absolute difference from fbm
+     * @param min_interval Octaves with a shorter keyframe interval than this are evaluated every frame
+     * @param curvature Bound of |d^2 noise / dz^2|, gen.second_derivative() or else estimated from the generator when 0
+     */
+    basic_animated_fbm(const pn::basic_generator<T>& gen, const grid2& grid, const T zoom_factor, const T max_error,
+                       const T min_interval, T curvature = 0) : gen(gen), grid(grid), zoom_factor(zoom_factor) {
+      if (curvature <= 0) { curvature = gen.second_derivative(); }
+      if (curvature <= 0) { curvature = estimate_curvature(gen); }
+      const bool continuous = !(gen.max_jump(3) > 0);
+      for (T zoom = zoom_factor; zoom >= 1.0; zoom /= 2) {
+        octave o;
+        o.zoom = zoom;
+        o.weight = zoom / zoom_factor;
+        layers.push_back(o);
+      }
+      const T share = max_error / layers.size();
+      for (size_t i = 0; i < layers.size(); i++) {
+        octave& o = layers[i];
+        // (interval / zoom)^2 / 8 * weight * C <= share
+        const T interval = o.zoom * std::sqrt(8 * share / (o.weight * curvature));
+        if (!continuous || interval < min_interval || !(interval > 0)) { continue; }
+        o.interval = interval;
+        o.phase = interval * i / layers.size();
+        for (int p = 0; p < 2; p++) {
+          o.keys[p].resize(grid.nx * grid.ny);
+          o.stamps[p].assign(grid.ny, INT64_MIN);
+        }
+      }
+    }
+
+    /// Number of octaves of the fbm
+    size_t num_octaves() const { return layers.size(); }
+
+    /// Keyframe interval of an octave (finest last), 0 when the octave is evaluated every frame
+    T interval(const size_t octave) const { return layers[octave].interval; }
+
+    /**
+     * Writes the field at time for the rows [row_begin, row_end) to out[j * grid.stride + i], refreshing the
+     * keyframes of those rows when needed. Calls for disjoint row ranges may run concurrently.
+     */
+    void evaluate(const T time, const size_t row_begin, const size_t row_end, T* out) {
+      std::vector<T> direct(grid.nx);
+      for (size_t j = row_begin; j < row_end; j++) {
+        T* row = out + j * grid.stride;
+        std::fill(row, row + grid.nx, T(0));
+        for (octave& o : layers) {
+          if (o.interval == 0) {
+            sample_row(o.zoom, time, j, direct.data());
+            for (size_t i = 0; i < grid.nx; i++) { row[i] += direct[i] * o.zoom; }
+            continue;
+          }
+          const T u = (time - o.phase) / o.interval;
+          const int64_t k = (int64_t) std::floor(u);
+          const T* a = keyframe(o, k, j);
+          const T* b = keyframe(o, k + 1, j);
+          const T w = u - k;
+          for (size_t i = 0; i < grid.nx; i++) { row[i] += ((1 - w) * a[i] + w * b[i]) * o.zoom; }
+        }
+        for (size_t i = 0; i < grid.nx; i++) { row[i] /= zoom_factor; }
+      }
+    }
+
+    /// Largest sampled |d^2 noise / dz^2| of the generator with a 1.5x safety margin
+    static T estimate_curvature(const pn::basic_generator<T>& gen, const size_t samples = 4096) {
+      std::mt19937 engine(samples);
+      std::uniform_real_distribution<T> distr(-256.0, 256.0);
+      const T h = T(1.0 / 64.0);
+      T curvature = 0;
+      for (size_t n = 0; n < samples; n++) {
+        const T x = distr(engine);
+        const T y = distr(engine);
+        const T z = distr(engine);
+        const T second = (gen(x, y, z + h) - 2 * gen(x, y, z) + gen(x, y, z - h)) / (h * h);
+        curvature = std::max(curvature, std::abs(second));
+      }
+      return T(1.5) * curvature;
+    }
+
+  private:
+    struct octave {
+      T zoom = 0;
+      T weight = 0;
+      T interval = 0; // 0 when evaluated every frame
+      T phase = 0;    // Keyframe k is at time phase + k * interval
+      std::vector<T> keys[2];      // Keyframe k is stored in keys[k & 1]
+      std::vector<int64_t> stamps[2]; // Keyframe held by each row of keys[p]
+    };
+
+    const pn::basic_generator<T>& gen;
+    const grid2 grid;
+    const T zoom_factor;
+    std::vector<octave> layers;
+
+    /// Noise of an octave over one row of the grid at time
+    void sample_row(const T zoom, const T time, const size_t j, T* out) const {
+      const grid3 row{grid.x0 / zoom, (grid.y0 + j * grid.dy) / zoom, time / zoom, grid.dx / zoom, 0, 0, grid.nx, 1, 1};
+      gen.fill(row, out);
+    }
+
+    /// Row j of keyframe k of the octave, evaluated if the buffer holds another keyframe
+    const T* keyframe(octave& o, const int64_t k, const size_t j) const {
+      const int p = (int) (k & 1);
+      T* row = o.keys[p].data() + j * grid.nx;
+      if (o.stamps[p][j] != k) {
+        sample_row(o.zoom, o.phase + k * o.interval, j, row);
+        o.stamps[p][j] = k;
+      }
+      return row;
+    }
+  };
+
+  using animated_fbm = basic_animated_fbm<double>;
+  using animated_fbmf = basic_animated_fbm<float>;
+}
+
+#endif // ANIMATION_H
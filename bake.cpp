@@ -0,0 +1,141 @@
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include "noise.hpp"
+#include "pool.hpp"
+#include "export.hpp"
+#include "trace.hpp"
+
+/**
+ * Bakes fbm of a noise generator into a field file (see export.hpp) that can be far larger than memory.
+ *
+ * The field is generated tile by tile on all hardware threads and written through a memory mapping. Running the same
+ * command again after an interruption resumes at the first tile that was not synced to disk. Built with PN_TRACE,
+ * --trace writes the timeline of the last spans of every thread when the bake ends.
+ *
+ * Usage: noise_bake --out=file [--size=4096x4096[x64]] [--tile=256] [--format=float32|uint16]
+ *                   [--generator=patent|tables|improved|original] [--zoom=64] [--seed=1] [--restart] [--trace=file]
+ */
+
+/// Parses "WxH" or "WxHxD" into sample counts, D = 0 for 2D
+bool parse_size(const char* text, size_t& nx, size_t& ny, size_t& nz) {
+  unsigned long long w = 0, h = 0, d = 0;
+  const int count = std::sscanf(text, "%llux%llux%llu", &w, &h, &d);
+  if (count < 2 || w == 0 || h == 0 || (count == 3 && d == 0)) { return false; }
+  nx = (size_t) w;
+  ny = (size_t) h;
+  nz = count == 3 ? (size_t) d : 0;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::string out_path;
+  size_t nx = 4096, ny = 4096, nz = 0;
+  size_t tile = 256;
+  pn::sample_format format = pn::sample_format::float32;
+  std::string generator = "patent";
+  double zoom = 64.0;
+  long seed = 1;
+  bool restart = false;
+  std::string trace_path;
+  bool usage = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 6, "--out=") == 0) {
+      out_path = arg.substr(6);
+    } else if (arg.compare(0, 7, "--size=") == 0) {
+      usage |= !parse_size(arg.c_str() + 7, nx, ny, nz);
+    } else if (arg.compare(0, 7, "--tile=") == 0) {
+      tile = (size_t) std::strtoul(arg.c_str() + 7, nullptr, 10);
+    } else if (arg == "--format=float32") {
+      format = pn::sample_format::float32;
+    } else if (arg == "--format=uint16") {
+      format = pn::sample_format::uint16;
+    } else if (arg.compare(0, 12, "--generator=") == 0) {
+      generator = arg.substr(12);
+    } else if (arg.compare(0, 7, "--zoom=") == 0) {
+      zoom = std::strtod(arg.c_str() + 7, nullptr);
+    } else if (arg.compare(0, 7, "--seed=") == 0) {
+      seed = std::strtol(arg.c_str() + 7, nullptr, 10);
+    } else if (arg == "--restart") {
+      restart = true;
+    } else if (arg.compare(0, 8, "--trace=") == 0) {
+      trace_path = arg.substr(8);
+    } else {
+      usage = true;
+    }
+  }
+
+  std::unique_ptr<pn::generator> gen;
+  if (generator == "patent") {
+    gen.reset(new pn::simplex::patent(seed));
+  } else if (generator == "tables") {
+    gen.reset(new pn::simplex::tables<>(seed));
+  } else if (generator == "improved") {
+    gen.reset(new pn::perlin::improved<>(seed));
+  } else if (generator == "original") {
+    gen.reset(new pn::perlin::Original(seed));
+  }
+  if (usage || out_path.empty() || !gen || tile == 0 || zoom < 1.0) {
+    std::cerr << "Usage: " << argv[0] << " --out=file [--size=4096x4096[x64]] [--tile=256] [--format=float32|uint16]"
+              << " [--generator=patent|tables|improved|original] [--zoom=64] [--seed=1] [--restart] [--trace=file]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // One sample per unit of noise space, the zoom factor sets the size of the features
+  std::unique_ptr<pn::field_writer> writer;
+  if (nz == 0) {
+    writer.reset(new pn::field_writer(out_path, pn::grid2{0.0, 0.0, 1.0, 1.0, nx, ny}, format, tile, tile, -1.0, 1.0,
+                                      !restart));
+  } else {
+    writer.reset(new pn::field_writer(out_path, pn::grid3{0.0, 0.0, 0.0, 1.0, 1.0, 1.0, nx, ny, nz}, format, tile,
+                                      tile, tile, -1.0, 1.0, !restart));
+  }
+  if (!writer->ok()) {
+    std::cerr << writer->error() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (writer->tiles_done() > 0) {
+    std::printf("resuming at %zu / %zu tiles\n", writer->tiles_done(), writer->num_tiles());
+  }
+
+  const bool is_2d = nz == 0;
+  const pn::generator& noise = *gen;
+  auto fill = [&](const pn::grid3& grid, double* out) {
+    for (size_t k = 0; k < grid.nz; k++) {
+      for (size_t j = 0; j < grid.ny; j++) {
+        double* row = out + k * grid.slice_stride + j * grid.stride;
+        const double y = grid.y0 + j * grid.dy;
+        const double z = grid.z0 + k * grid.dz;
+        for (size_t i = 0; i < grid.nx; i++) {
+          const double x = grid.x0 + i * grid.dx;
+          row[i] = is_2d ? noise.fbm(x, y, zoom) : noise.fbm(x, y, z, zoom);
+        }
+      }
+    }
+  };
+  auto start = std::chrono::high_resolution_clock::now();
+  auto progress = [&](size_t done, size_t total) {
+    const double s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    std::printf("\r%zu / %zu tiles (%.1f%%) %.1f s", done, total, 100.0 * done / total, s);
+    std::fflush(stdout);
+    return true;
+  };
+
+  if (!trace_path.empty()) {
+    pn::trace::set_thread_name("main");
+    pn::trace::write_at_exit(trace_path);
+  }
+  pn::pool workers; // One worker per hardware thread
+  const bool complete = writer->run(workers, fill, progress);
+  std::printf("\n");
+  if (!complete) {
+    std::cerr << (writer->ok() ? "incomplete" : writer->error()) << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
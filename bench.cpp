@@ -0,0 +1,639 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "noise.hpp"
+#include "fixed.hpp"
+#include "color.hpp"
+#include "graph.hpp"
+#include "cache.hpp"
+#include "pool.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+/**
+ * Headless benchmark of the noise generators, no graphics dependencies.
+ *
+ * For every generator, dimension and operation it reports ns/sample, samples/sec and the speedup over the first thread
+ * count (a single thread by default) for each thread count. Results are printed as a table and optionally written as CSV or JSON for tracking regressions.
+ * Built with PN_METRICS the runtime metrics of the whole run are printed after the table, built with PN_TRACE --trace
+ * writes the timeline of the last spans of every thread.
+ * --verify skips the timings and checks that the fixed-point generators stay within FIXED_TOLERANCE of the floating
+ * point ones they are built like, that compiled graph fbm matches fbm, that the patent simplex matches its reference
+ * values and only repeats after 16 cells in 2D and that fill_fbm stays within the error bound it returns of fbm for
+ * every generator, the exit status is non-zero otherwise.
+ *
+ * Usage: noise_bench [--threads=1,2,4] [--scale=1.0] [--filter=substring] [--csv=file] [--json=file] [--trace=file]
+ *                    [--verify]
+ */
+
+/** Seed of every generator */
+const int SEED = 1;
+/** Zoom factor of the fractal operations, 7 octaves */
+const double ZOOM = 64.0;
+/** Number of octaves of the octaves operation */
+const int OCTAVES = 6;
+/** Threshold of the octaves_above operation */
+const double ISO_LEVEL = 0.3;
+/** Spacing between samples in noise space */
+const double STEP = 0.173;
+/**
+ * Largest difference allowed between a fixed-point generator and its floating point counterpart. The quantization alone
+ * stays below 2e-3, 3D simplex::tables jumps by a few 1e-3 across simplex faces (its surflets reach past them) and a
+ * point within a Q14 step of a face can fall in the neighbouring simplex.
+ */
+const double FIXED_TOLERANCE = 1e-2;
+/** Random points compared per generator and dimension by --verify */
+const int VERIFY_POINTS = 1000000;
+/** Width and height of the grids fill_fbm is compared to fbm on by --verify, at spacings STEP and STEP * ZOOM */
+const size_t FBM_VERIFY_SIZE = 256;
+/** Error budget of fill_fbm in --verify, the fill must stay within the bound it returns */
+const double FBM_MAX_ERROR = 1e-3;
+/** Largest difference allowed between a compiled graph fbm and fbm, they sum the same terms in the same order */
+const double GRAPH_TOLERANCE = 1e-12;
+/**
+ * Largest difference allowed between simplex::patent and the reference values below. The tabulated traversal does
+ * the same operations as the original bit twiddling, so the values are identical unless the build contracts to FMA.
+ */
+const double PATENT_TOLERANCE = 1e-12;
+/**
+ * x, y, z, value and gradient of 3D simplex::patent(SEED), computed by the implementation before the gradients and the
+ * simplex traversal were tabulated.
+ */
+const double PATENT_REFERENCE[][7] = {
+  {0.0000, 0.0000, 0.0000, 0, -1.0367999999999999, 1.0367999999999999, 1.0367999999999999},
+  {0.2500, -0.5000, 1.0000, -0.054656445312499954, 0.82011072048611056, 0.42246527777777748, -0.17400288628472207},
+  {0.5000, -1.0000, 2.0000, 0.03921666666666665, -0.041866666666666504, -0.010666666666667214, -0.010666666666666666},
+  {0.7500, -1.5000, 3.0000, -0.040992333984374962, 0.83938569878472158, 0.6263047743055552, 0.0036965711805554899},
+  {-107.0577, 174.3304, 172.3173, -0.14382342923367181, -0.82991986491314618, -0.10119939042994387, -0.10812079135993249},
+  {194.0316, -154.0271, 429.5282, 0.027836448439619875, 0.25284760998471206, -0.1870946082202497, -0.15971280552126185},
+  {-237.4162, 250.7627, -245.1059, -0.057632405999842783, 0.22791235156275808, -0.40330619067129408, 0.094481186679592821},
+  {351.2946, -325.9472, 290.7635, -0.026596684010927102, 0.3566213490690327, -0.069052168506289105, -0.3681847612357988},
+  {437.6293, -51.1742, -115.3504, -0.17027100056213951, 0.78090633282446031, -0.52653895432834796, -0.031121567379028443},
+  {-142.5248, -306.6444, -399.5260, -0.047176255858752819, 0.094010286953749078, 0.80252184985410846, 0.092762866494011387},
+  {-17.3631, 113.7035, 451.2483, 0.20878387112871322, -0.40563245955336363, -0.28551840103936305, 0.034408559264907039},
+  {-151.2436, -223.4853, -53.4941, -0.056275690208664172, -0.62090276581430726, 0.57026416738640628, -0.83115870828647598},
+  {457.9137, -320.4231, -357.2843, -0.086094844432883233, 0.062282968651429613, -0.2881735163998288, -0.0096507450472017031},
+  {-416.4919, 47.2351, -189.7908, 0.050702660862639665, 0.46827302863586301, 0.79629946534414042, 0.10404648724225696},
+  {-217.2803, 420.9935, -66.6578, 0.087883249384506965, -0.24153987109848565, 0.75581642852754749, -0.31184278947777988},
+  {-81.2428, 486.2231, 293.5700, 0.044830401883984669, -0.27808924967604853, 0.14301370572152811, -0.081218522234421484}
+};
+/**
+ * x, y, value and gradient of 2D simplex::patent(SEED). The implementation before the tables indexed past the bit
+ * patterns, so these come from the first one that selects the patterns by bit B of i and j.
+ */
+const double PATENT_REFERENCE_2D[][5] = {
+  {2.3000, 0.7000, 0.0058580597369185397, 0.1346680887829271, -0.14781794778623628},
+  {1.2500, -0.5000, -0.20256110489161008, -1.4435979765736449, -1.2679782978702983},
+  {0.5000, -1.0000, 3.1145151307355499e-06, -5.2913428936571483e-05, -0.00069549389318977468},
+  {0.7500, -1.5000, 0.26638664747605389, -2.0811689449274082, -0.63588271725812162},
+  {-107.0577, 174.3304, -0.0091413110818228706, 0.26099031869434453, -0.030611055183279903},
+  {194.0316, -154.0271, 0.29209590576583272, 1.4814518481901477, 0.72100757672185767},
+  {-237.4162, 250.7627, -0.11362333456228735, -0.17848419530262943, -0.29208308484650353},
+  {351.2946, -325.9472, 0.096232246597370646, -0.44849069270220515, -0.57174839457835269},
+  {437.6293, -51.1742, 0.012855037654373151, 2.2794862038593102, -0.065142546269323032},
+  {-142.5248, -306.6444, -0.031730923587488538, -3.3620953381911733, -3.4481490561805175},
+  {-17.3631, 113.7035, 0.25050688057161324, -3.0808363159615428, 0.02963902095300594},
+  {-151.2436, -223.4853, -0.023323066716344362, -0.27362201744217096, -0.2569810012678268},
+  {457.9137, -320.4231, 0.37238532588738743, -0.29454829456402193, 1.2690289494638372},
+  {-416.4919, 47.2351, -0.43746511916520286, 1.514500859514575, 1.448930868193542},
+  {-217.2803, 420.9935, -0.00072501278881263818, -0.32130199008597332, 0.065594855848165573},
+  {-81.2428, 486.2231, 0.0018299458169289836, -0.14473917624407448, 1.6249025205083218}
+};
+/** Lattice period of 2D simplex::patent, its gradients depend on bits 0-3 of the lattice coordinates */
+const int PATENT_PERIOD_2D = 16;
+/** Smallest max |diff| between 2D simplex::patent and itself shifted by less than PATENT_PERIOD_2D cells */
+const double PATENT_SHIFT_DIFFERENCE = 0.1;
+/** Side of the tiles of the raw_cached operation */
+const size_t CACHE_TILE = 64;
+/** Budget of the tile cache, a fraction of the tiles of a full size raw_cached grid so that it evicts */
+const size_t CACHE_BYTES = 4 << 20;
+/** Colour ramp of the raw_rgba8 and raw_r16 operations, gamma 2.2 */
+const pn::color_map COLORS(pn::color_map::terrain(), -1.0, 1.0, 2.2);
+
+/** Tiles of the raw_cached operation, cleared before every measurement */
+pn::tile_cache TILES(CACHE_BYTES);
+
+struct Generator {
+  const char* name;
+  std::unique_ptr<pn::generator> gen;
+  bool has_3d;
+};
+
+/// Every generator of the library, built from SEED
+std::vector<Generator> make_generators() {
+  std::vector<Generator> generators;
+  generators.push_back({"simplex::patent", std::unique_ptr<pn::generator>(new pn::simplex::patent(SEED)), true});
+  generators.push_back({"simplex::tables", std::unique_ptr<pn::generator>(new pn::simplex::tables<>(SEED)), true});
+  generators.push_back({"perlin::improved", std::unique_ptr<pn::generator>(new pn::perlin::improved<>(SEED)), true});
+  generators.push_back({"perlin::Original", std::unique_ptr<pn::generator>(new pn::perlin::Original(SEED)), true});
+  // Hashing policies, the entries above use the default permutation table
+  generators.push_back({"perlin::improved/integer", std::unique_ptr<pn::generator>(
+      new pn::perlin::improved<256, pn::hash::integer>(SEED)), true});
+  generators.push_back({"perlin::Original/integer", std::unique_ptr<pn::generator>(
+      new pn::perlin::basic_original<double, pn::hash::integer>(SEED)), true});
+  // Fixed-point counterparts of the generators above
+  generators.push_back({"fixed::improved", std::unique_ptr<pn::generator>(new pn::fixed::improved<>(SEED)), true});
+  generators.push_back({"fixed::tables", std::unique_ptr<pn::generator>(new pn::fixed::tables<>(SEED)), true});
+  return generators;
+}
+
+struct Operation {
+  const char* name;
+  int dims;
+  size_t samples; // Samples per measurement at scale 1.0
+};
+
+struct Result {
+  std::string generator;
+  std::string operation;
+  int dims;
+  size_t threads;
+  size_t samples;
+  double ns_per_sample;
+  double samples_per_sec;
+  double speedup;
+};
+
+/// Evaluates the operation over the rows [y0, y1) of a square grid and returns the sum of the samples
+double run_rows(const pn::generator& gen, const Operation& op, size_t width, size_t y0, size_t y1) {
+  double sum = 0.0;
+  const double z = 0.5;
+  if (std::strcmp(op.name, "raw") == 0) {
+    // Raw noise goes through the batched fill, the way grids are meant to be generated
+    std::vector<double> row(width);
+    for (size_t y = y0; y < y1; y++) {
+      if (op.dims == 2) {
+        gen.fill(pn::grid2{0.0, y * STEP, STEP, STEP, width, 1}, row.data());
+      } else {
+        gen.fill(pn::grid3{0.0, y * STEP, z, STEP, STEP, STEP, width, 1, 1}, row.data());
+      }
+      for (const double v : row) { sum += v; }
+    }
+    return sum;
+  }
+  if (std::strcmp(op.name, "raw_rgba8") == 0 || std::strcmp(op.name, "raw_r16") == 0) {
+    // Raw noise converted to texels, the cost of the colour mapping on top of raw
+    std::vector<double> row(width);
+    std::vector<uint32_t> pixels(width);
+    std::vector<uint16_t> texels(width);
+    const bool rgba8 = std::strcmp(op.name, "raw_rgba8") == 0;
+    for (size_t y = y0; y < y1; y++) {
+      gen.fill(pn::grid2{0.0, y * STEP, STEP, STEP, width, 1}, row.data());
+      if (rgba8) {
+        COLORS.rgba8(row.data(), pixels.data(), width);
+        for (const uint32_t p : pixels) { sum += p & 0xff; }
+      } else {
+        COLORS.r16(row.data(), texels.data(), width);
+        for (const uint16_t t : texels) { sum += t; }
+      }
+    }
+    return sum;
+  }
+  if (std::strcmp(op.name, "raw_cached") == 0) {
+    // Raw noise read row by row out of cached tiles, a miss for the first row of a tile and hits for the others
+    const uint64_t params = pn::hash_params((uintptr_t) &gen, STEP);
+    for (size_t y = y0; y < y1; y++) {
+      const size_t ty = y / CACHE_TILE;
+      for (size_t tx = 0; tx * CACHE_TILE < width; tx++) {
+        const pn::tile_key key = pn::make_tile_key<pn::generator>(SEED, params, tx, ty);
+        const pn::tile_cache::buffer tile = TILES.get_or_compute(key, CACHE_TILE * CACHE_TILE, [&](double* out) {
+          gen.fill(pn::grid2{tx * CACHE_TILE * STEP, ty * CACHE_TILE * STEP, STEP, STEP, CACHE_TILE, CACHE_TILE}, out);
+        });
+        const double* row = tile->data() + (y % CACHE_TILE) * CACHE_TILE;
+        const size_t n = std::min(CACHE_TILE, width - tx * CACHE_TILE);
+        for (size_t i = 0; i < n; i++) { sum += row[i]; }
+      }
+    }
+    return sum;
+  }
+  if (std::strcmp(op.name, "graph_fbm") == 0) {
+    // Same points as fbm, evaluated by a program compiled from a one-source graph
+    pn::graph graph;
+    const pn::program program = graph.compile(graph.fractal(graph.source(gen), pn::fractal_mode::fbm, ZOOM), op.dims);
+    std::vector<double> row(width);
+    for (size_t y = y0; y < y1; y++) {
+      if (op.dims == 2) {
+        program.fill(pn::grid2{0.0, y * STEP * ZOOM, STEP * ZOOM, STEP * ZOOM, width, 1}, row.data());
+      } else {
+        program.fill(pn::grid3{0.0, y * STEP * ZOOM, z * ZOOM, STEP * ZOOM, STEP * ZOOM, STEP * ZOOM, width, 1, 1}, row.data());
+      }
+      for (const double v : row) { sum += v; }
+    }
+    return sum;
+  }
+  if (std::strcmp(op.name, "fbm_multires") == 0) {
+    // Same points as fbm, the coarse octaves upsampled from sparser grids
+    std::vector<double> band(width * (y1 - y0));
+    gen.fill_fbm(pn::grid2{0.0, y0 * STEP * ZOOM, STEP * ZOOM, STEP * ZOOM, width, y1 - y0}, band.data(), ZOOM);
+    for (const double v : band) { sum += v; }
+    return sum;
+  }
+  for (size_t y = y0; y < y1; y++) {
+    for (size_t x = 0; x < width; x++) {
+      const double px = x * STEP;
+      const double py = y * STEP;
+      if (std::strcmp(op.name, "fbm") == 0) {
+        sum += op.dims == 2 ? gen.fbm(px * ZOOM, py * ZOOM, ZOOM) : gen.fbm(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM);
+      } else if (std::strcmp(op.name, "fbm_filtered") == 0) {
+        // Same points as fbm, the octaves finer than the sample spacing are skipped
+        const double footprint = STEP * ZOOM;
+        sum += op.dims == 2 ? gen.fbm_filtered(px * ZOOM, py * ZOOM, ZOOM, footprint)
+                            : gen.fbm_filtered(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM, footprint);
+      } else if (std::strcmp(op.name, "octaves") == 0) {
+        sum += op.dims == 2 ? gen.octaves(px, py, OCTAVES, 0.5) : gen.octaves(px, py, z, OCTAVES, 0.5);
+      } else if (std::strcmp(op.name, "octaves_above") == 0) {
+        // Same points as octaves, only the side of the iso level is needed
+        sum += gen.octaves_above(px, py, z, OCTAVES, ISO_LEVEL, 0.5) ? 1.0 : 0.0;
+      } else if (std::strcmp(op.name, "turbulence_ridged") == 0) {
+        sum += gen.turbulence_ridged(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM);
+      } else if (std::strcmp(op.name, "domain_wrapping") == 0) {
+        sum += gen.domain_wrapping(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM);
+      } else if (std::strcmp(op.name, "domain_wrapping_channels") == 0) {
+        sum += gen.domain_wrapping_channels(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM);
+      } else if (std::strcmp(op.name, "fbm_channels") == 0) {
+        // Three channels, e.g. a flow field or an RGB texture
+        double v[3];
+        if (op.dims == 2) {
+          gen.fbm_channels(px * ZOOM, py * ZOOM, ZOOM, v, 3);
+        } else {
+          gen.fbm_channels(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM, v, 3);
+        }
+        sum += v[0] + v[1] + v[2];
+      } else if (std::strcmp(op.name, "fbm_gradient") == 0) {
+        if (op.dims == 2) {
+          const pn::derivative2 d = gen.fbm_with_gradient(px * ZOOM, py * ZOOM, ZOOM);
+          sum += d.value + d.gradient.x + d.gradient.y;
+        } else {
+          const pn::derivative3 d = gen.fbm_with_gradient(px * ZOOM, py * ZOOM, z * ZOOM, ZOOM);
+          sum += d.value + d.gradient.x + d.gradient.y + d.gradient.z;
+        }
+      } else if (std::strcmp(op.name, "fbm_central_diff") == 0) {
+        // Value and gradient the way it is done without the derivatives API, for comparison with fbm_gradient
+        const double h = 1e-3 * ZOOM;
+        const double X = px * ZOOM, Y = py * ZOOM, Z = z * ZOOM;
+        if (op.dims == 2) {
+          sum += gen.fbm(X, Y, ZOOM) + (gen.fbm(X + h, Y, ZOOM) - gen.fbm(X - h, Y, ZOOM)) / (2 * h) +
+                 (gen.fbm(X, Y + h, ZOOM) - gen.fbm(X, Y - h, ZOOM)) / (2 * h);
+        } else {
+          sum += gen.fbm(X, Y, Z, ZOOM) + (gen.fbm(X + h, Y, Z, ZOOM) - gen.fbm(X - h, Y, Z, ZOOM)) / (2 * h) +
+                 (gen.fbm(X, Y + h, Z, ZOOM) - gen.fbm(X, Y - h, Z, ZOOM)) / (2 * h) +
+                 (gen.fbm(X, Y, Z + h, ZOOM) - gen.fbm(X, Y, Z - h, ZOOM)) / (2 * h);
+        }
+      }
+    }
+  }
+  return sum;
+}
+
+/** Rows of the benchmark grid per pool task */
+const size_t ROWS_PER_TASK = 4;
+
+/// Wall time of a measurement and the samples it evaluated
+struct Timing {
+  double ns;
+  size_t samples;
+};
+    
+/// Runs the operation over a grid of about samples points split in bands of rows scheduled on the pool
+Timing measure(pn::pool& workers, const pn::generator& gen, const Operation& op, size_t samples) {
+  const size_t width = std::max<size_t>(1, (size_t) std::sqrt((double) samples));
+  const size_t height = std::max<size_t>(1, samples / width);
+  const size_t num_tasks = (height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+  std::vector<double> sums(num_tasks, 0.0);
+  TILES.clear(); // raw_cached starts cold, whatever the previous measurement left
+  auto start = std::chrono::high_resolution_clock::now();
+  workers.run(num_tasks, [&](size_t t, size_t) {
+    sums[t] = run_rows(gen, op, width, t * ROWS_PER_TASK, std::min(height, (t + 1) * ROWS_PER_TASK));
+  });
+  auto end = std::chrono::high_resolution_clock::now();
+  volatile double sink = 0.0;
+  for (const double sum : sums) { sink = sink + sum; }
+  return {(double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), width * height};
+}
+
+void write_csv(std::ostream& out, const std::vector<Result>& results) {
+  out << "generator,operation,dims,threads,samples,ns_per_sample,samples_per_sec,speedup\n";
+  for (const Result& r : results) {
+    out << r.generator << "," << r.operation << "," << r.dims << "," << r.threads << "," << r.samples << ","
+        << r.ns_per_sample << "," << r.samples_per_sec << "," << r.speedup << "\n";
+  }
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results) {
+  out << "{\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    out << "    {\"generator\": \"" << r.generator << "\", \"operation\": \"" << r.operation << "\", \"dims\": " << r.dims
+        << ", \"threads\": " << r.threads << ", \"samples\": " << r.samples << ", \"ns_per_sample\": " << r.ns_per_sample
+        << ", \"samples_per_sec\": " << r.samples_per_sec << ", \"speedup\": " << r.speedup << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+}
+
+/// Largest difference between two generators over random points in [-1000, 1000]
+double max_difference(const pn::generator& a, const pn::generator& b, const int dims, const int points) {
+  std::mt19937 engine(SEED);
+  std::uniform_real_distribution<double> distr(-1000.0, 1000.0);
+  double worst = 0.0;
+  for (int i = 0; i < points; i++) {
+    const double x = distr(engine);
+    const double y = distr(engine);
+    const double z = distr(engine);
+    const double d = dims == 2 ? std::fabs(a(x, y) - b(x, y)) : std::fabs(a(x, y, z) - b(x, y, z));
+    worst = std::max(worst, d);
+  }
+  return worst;
+}
+
+/// Compares the fixed-point generators to the floating point ones, true if all are within FIXED_TOLERANCE
+bool verify_fixed(const double scale) {
+  struct Pair {
+    const char* name;
+    std::unique_ptr<pn::generator> reference;
+    std::unique_ptr<pn::generator> fixed;
+  };
+  std::vector<Pair> pairs;
+  pairs.push_back({"fixed::improved", std::unique_ptr<pn::generator>(new pn::perlin::improved<>(SEED)),
+                   std::unique_ptr<pn::generator>(new pn::fixed::improved<>(SEED))});
+  pairs.push_back({"fixed::improved/integer", std::unique_ptr<pn::generator>(new pn::perlin::improved<256, pn::hash::integer>(SEED)),
+                   std::unique_ptr<pn::generator>(new pn::fixed::improved<256, pn::hash::integer>(SEED))});
+  pairs.push_back({"fixed::tables", std::unique_ptr<pn::generator>(new pn::simplex::tables<>(SEED)),
+                   std::unique_ptr<pn::generator>(new pn::fixed::tables<>(SEED))});
+  const int points = std::max(1, (int) (VERIFY_POINTS * scale));
+  bool ok = true;
+  std::printf("%-26s %4s %14s %10s\n", "generator", "dims", "max |diff|", "tolerance");
+  for (const Pair& p : pairs) {
+    for (int dims = 2; dims <= 3; dims++) {
+      const double diff = max_difference(*p.reference, *p.fixed, dims, points);
+      std::printf("%-26s %4d %14.6f %10.6f%s\n", p.name, dims, diff, FIXED_TOLERANCE, diff > FIXED_TOLERANCE ? "  FAIL" : "");
+      ok = ok && diff <= FIXED_TOLERANCE;
+    }
+  }
+  return ok;
+}
+
+/// Compares fbm compiled from a one-source graph to fbm of the source, true if all are within GRAPH_TOLERANCE
+bool verify_graph(const double scale) {
+  std::vector<Generator> generators;
+  generators.push_back({"simplex::patent", std::unique_ptr<pn::generator>(new pn::simplex::patent(SEED)), true});
+  generators.push_back({"simplex::tables", std::unique_ptr<pn::generator>(new pn::simplex::tables<>(SEED)), true});
+  generators.push_back({"perlin::improved", std::unique_ptr<pn::generator>(new pn::perlin::improved<>(SEED)), true});
+  generators.push_back({"perlin::Original", std::unique_ptr<pn::generator>(new pn::perlin::Original(SEED)), true});
+  const size_t points = std::max<size_t>(1, (size_t) (VERIFY_POINTS / 10 * scale));
+  std::mt19937 engine(SEED);
+  std::uniform_real_distribution<double> distr(-1000.0, 1000.0);
+  std::vector<double> x(points), y(points), z(points), out(points);
+  bool ok = true;
+  std::printf("%-26s %4s %14s %10s\n", "graph fbm", "dims", "max |diff|", "tolerance");
+  for (const Generator& g : generators) {
+    for (int dims = 2; dims <= 3; dims++) {
+      pn::graph graph;
+      const pn::program program = graph.compile(graph.fractal(graph.source(*g.gen), pn::fractal_mode::fbm, ZOOM), dims);
+      for (size_t i = 0; i < points; i++) {
+        x[i] = distr(engine);
+        y[i] = distr(engine);
+        z[i] = distr(engine);
+      }
+      program.evaluate(x.data(), y.data(), z.data(), out.data(), points);
+      double diff = 0.0;
+      for (size_t i = 0; i < points; i++) {
+        const double expected = dims == 2 ? g.gen->fbm(x[i], y[i], ZOOM) : g.gen->fbm(x[i], y[i], z[i], ZOOM);
+        diff = std::max(diff, std::fabs(out[i] - expected));
+      }
+      // One point at a time as well, the path of program::operator()
+      for (size_t i = 0; i < std::min<size_t>(points, 1000); i++) {
+        const double value = dims == 2 ? program(x[i], y[i]) : program(x[i], y[i], z[i]);
+        diff = std::max(diff, std::fabs(value - out[i]));
+      }
+      std::printf("%-26s %4d %14.3g %10.3g%s\n", g.name, dims, diff, GRAPH_TOLERANCE, diff > GRAPH_TOLERANCE ? "  FAIL" : "");
+      ok = ok && diff <= GRAPH_TOLERANCE;
+    }
+  }
+  return ok;
+}
+
+/// Compares fill_fbm to fbm at every sample of two grids, true if every generator stays within the bound it returns
+bool verify_fbm(const double scale) {
+  const std::vector<Generator> generators = make_generators();
+  const size_t size = std::max<size_t>(4, (size_t) (FBM_VERIFY_SIZE * std::sqrt(scale)));
+  std::vector<double> out(size * size);
+  bool ok = true;
+  std::printf("%-26s %8s %14s %10s\n", "fill_fbm", "spacing", "max |diff|", "bound");
+  for (const Generator& g : generators) {
+    for (const double spacing : {STEP, STEP * ZOOM}) {
+      const pn::grid2 grid{-3.7, 11.3, spacing, spacing, size, size};
+      const double bound = g.gen->fill_fbm(grid, out.data(), ZOOM, FBM_MAX_ERROR);
+      double diff = 0.0;
+      for (size_t j = 0; j < size; j++) {
+        for (size_t i = 0; i < size; i++) {
+          const double expected = g.gen->fbm(grid.x0 + i * grid.dx, grid.y0 + j * grid.dy, ZOOM);
+          diff = std::max(diff, std::fabs(out[j * size + i] - expected));
+        }
+      }
+      // Rounding of the interpolation on top of the bound
+      const bool within = bound <= FBM_MAX_ERROR && diff <= bound + 1e-12;
+      std::printf("%-26s %8.3f %14.3g %10.3g%s\n", g.name, spacing, diff, bound, within ? "" : "  FAIL");
+      ok = ok && within;
+    }
+  }
+  return ok;
+}
+
+/**
+ * Compares simplex::patent to PATENT_REFERENCE and PATENT_REFERENCE_2D and checks that the 2D noise only repeats after
+ * PATENT_PERIOD_2D cells, true if every value and gradient is within PATENT_TOLERANCE and the shifts 1, 2, 4 and 8 along
+ * both axes differ by at least PATENT_SHIFT_DIFFERENCE
+ */
+bool verify_patent() {
+  const pn::simplex::patent gen(SEED);
+  double diff = 0.0;
+  for (const auto& ref : PATENT_REFERENCE) {
+    const pn::derivative3 d = gen.eval_with_gradient(ref[0], ref[1], ref[2]);
+    diff = std::max(diff, std::fabs(gen(ref[0], ref[1], ref[2]) - ref[3]));
+    diff = std::max(diff, std::fabs(d.value - ref[3]));
+    diff = std::max(diff, std::fabs(d.gradient.x - ref[4]));
+    diff = std::max(diff, std::fabs(d.gradient.y - ref[5]));
+    diff = std::max(diff, std::fabs(d.gradient.z - ref[6]));
+  }
+  double diff_2d = 0.0;
+  for (const auto& ref : PATENT_REFERENCE_2D) {
+    const pn::derivative2 d = gen.eval_with_gradient(ref[0], ref[1]);
+    diff_2d = std::max(diff_2d, std::fabs(gen(ref[0], ref[1]) - ref[2]));
+    diff_2d = std::max(diff_2d, std::fabs(d.value - ref[2]));
+    diff_2d = std::max(diff_2d, std::fabs(d.gradient.x - ref[3]));
+    diff_2d = std::max(diff_2d, std::fabs(d.gradient.y - ref[4]));
+  }
+  std::printf("%-26s %4s %14s %10s\n", "reference", "dims", "max |diff|", "tolerance");
+  std::printf("%-26s %4d %14.3g %10.3g%s\n", "simplex::patent", 3, diff, PATENT_TOLERANCE, diff > PATENT_TOLERANCE ? "  FAIL" : "");
+  std::printf("%-26s %4d %14.3g %10.3g%s\n", "simplex::patent", 2, diff_2d, PATENT_TOLERANCE,
+              diff_2d > PATENT_TOLERANCE ? "  FAIL" : "");
+  bool ok = diff <= PATENT_TOLERANCE && diff_2d <= PATENT_TOLERANCE;
+  // Shifting by whole lattice cells moves every vertex onto another one, the noise only repeats if their gradients do
+  std::mt19937 engine(SEED);
+  std::uniform_real_distribution<double> distr(-1000.0, 1000.0);
+  std::printf("%-26s %4s %14s %10s\n", "2D patent shift (cells)", "axis", "max |diff|", "minimum");
+  for (int shift = 1; shift < PATENT_PERIOD_2D; shift *= 2) {
+    for (int axis = 0; axis < 2; axis++) {
+      const pn::vec2 offset = gen.unskew(pn::vec2{double(axis == 0 ? shift : 0), double(axis == 1 ? shift : 0)});
+      double shifted = 0.0;
+      for (int n = 0; n < 1000; n++) {
+        const double x = distr(engine);
+        const double y = distr(engine);
+        shifted = std::max(shifted, std::fabs(gen(x, y) - gen(x + offset.x, y + offset.y)));
+      }
+      char name[32];
+      std::snprintf(name, sizeof(name), "%d", shift);
+      std::printf("%-26s %4s %14.3g %10.3g%s\n", name, axis == 0 ? "i" : "j", shifted, PATENT_SHIFT_DIFFERENCE,
+                  shifted < PATENT_SHIFT_DIFFERENCE ? "  FAIL" : "");
+      ok = ok && shifted >= PATENT_SHIFT_DIFFERENCE;
+    }
+  }
+  return ok;
+}
+
+/// Parses a comma separated list of thread counts
+std::vector<size_t> parse_threads(const char* list) {
+  std::vector<size_t> counts;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    const long count = std::strtol(item.c_str(), nullptr, 10);
+    if (count > 0) { counts.push_back((size_t) count); }
+  }
+  return counts;
+}
+
+int main(int argc, char** argv) {
+  std::vector<size_t> thread_counts;
+  double scale = 1.0;
+  std::string filter;
+  std::string csv_path;
+  std::string json_path;
+  std::string trace_path;
+  bool verify = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 10, "--threads=") == 0) {
+      thread_counts = parse_threads(arg.c_str() + 10);
+    } else if (arg.compare(0, 8, "--scale=") == 0) {
+      scale = std::strtod(arg.c_str() + 8, nullptr);
+    } else if (arg.compare(0, 9, "--filter=") == 0) {
+      filter = arg.substr(9);
+    } else if (arg.compare(0, 6, "--csv=") == 0) {
+      csv_path = arg.substr(6);
+    } else if (arg.compare(0, 7, "--json=") == 0) {
+      json_path = arg.substr(7);
+    } else if (arg.compare(0, 8, "--trace=") == 0) {
+      trace_path = arg.substr(8);
+    } else if (arg == "--verify") {
+      verify = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--threads=1,2,4] [--scale=1.0] [--filter=substring] [--csv=file] [--json=file]"
+                << " [--trace=file] [--verify]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (thread_counts.empty()) {
+    const size_t hw = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+    for (size_t n = 1; n < hw; n *= 2) { thread_counts.push_back(n); }
+    thread_counts.push_back(hw);
+  }
+  if (scale <= 0.0) { scale = 1.0; }
+  if (verify) {
+    const bool fixed_ok = verify_fixed(scale);
+    const bool graph_ok = verify_graph(scale);
+    const bool patent_ok = verify_patent();
+    const bool fbm_ok = verify_fbm(scale);
+    return fixed_ok && graph_ok && patent_ok && fbm_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+#ifndef __OPTIMIZE__
+  std::cerr << "warning: noise_bench was built without optimizations, build with -DCMAKE_BUILD_TYPE=Release" << std::endl;
+#endif
+  pn::trace::set_thread_name("main");
+
+  const std::vector<Generator> generators = make_generators();
+
+  const std::vector<Operation> operations = {
+    {"raw", 2, 4000000},
+    {"raw", 3, 2000000},
+    {"raw_cached", 2, 4000000},
+    {"raw_rgba8", 2, 4000000},
+    {"raw_r16", 2, 4000000},
+    {"fbm", 2, 500000},
+    {"fbm", 3, 300000},
+    {"graph_fbm", 2, 500000},
+    {"graph_fbm", 3, 300000},
+    {"fbm_filtered", 2, 500000},
+    {"fbm_filtered", 3, 300000},
+    {"fbm_multires", 2, 500000},
+    {"octaves", 2, 500000},
+    {"octaves", 3, 300000},
+    {"octaves_above", 3, 300000},
+    {"turbulence_ridged", 3, 300000},
+    {"domain_wrapping", 3, 30000},
+    {"domain_wrapping_channels", 3, 30000},
+    {"fbm_channels", 2, 200000},
+    {"fbm_channels", 3, 100000},
+    {"fbm_gradient", 2, 300000},
+    {"fbm_gradient", 3, 200000},
+    {"fbm_central_diff", 2, 100000},
+    {"fbm_central_diff", 3, 60000},
+  };
+
+  std::vector<std::unique_ptr<pn::pool>> pools;
+  for (const size_t threads : thread_counts) {
+    pools.emplace_back(new pn::pool(threads));
+  }
+
+  std::vector<Result> results;
+  std::printf("%-26s %-24s %4s %7s %12s %14s %8s\n", "generator", "operation", "dims", "threads", "ns/sample", "samples/sec", "speedup");
+  for (const Generator& g : generators) {
+    for (const Operation& op : operations) {
+      if (op.dims == 3 && !g.has_3d) { continue; }
+      const std::string id = std::string(g.name) + "/" + op.name + "/" + std::to_string(op.dims) + "d";
+      if (!filter.empty() && id.find(filter) == std::string::npos) { continue; }
+      const size_t samples = std::max<size_t>(1, (size_t) (op.samples * scale));
+      measure(*pools.front(), *g.gen, op, samples / 10 + 1); // Warm up caches and the CPU clock
+      double single_ns = 0.0;
+      for (size_t i = 0; i < thread_counts.size(); i++) {
+        const size_t threads = thread_counts[i];
+        const Timing t = measure(*pools[i], *g.gen, op, samples);
+        if (single_ns == 0.0) { single_ns = t.ns; }
+        Result r{g.name, op.name, op.dims, threads, t.samples, t.ns / t.samples, t.samples / (t.ns * 1e-9), single_ns / t.ns};
+        std::printf("%-26s %-24s %4d %7zu %12.2f %14.0f %8.2f\n", r.generator.c_str(), r.operation.c_str(), r.dims,
+                    r.threads, r.ns_per_sample, r.samples_per_sec, r.speedup);
+        results.push_back(r);
+      }
+    }
+  }
+
+  if (TILES.hits() + TILES.misses() > 0) {
+    std::printf("tile cache: %llu hits, %llu misses, %llu evictions\n", (unsigned long long) TILES.hits(),
+                (unsigned long long) TILES.misses(), (unsigned long long) TILES.evictions());
+  }
+  pn::metrics::dump(std::cout, pn::metrics::read());
+
+  if (!csv_path.empty()) {
+    std::ofstream csv(csv_path);
+    write_csv(csv, results);
+  }
+  if (!json_path.empty()) {
+    std::ofstream json(json_path);
+    write_json(json, results);
+  }
+  if (!trace_path.empty() && !pn::trace::write(trace_path)) {
+    std::cerr << (pn::trace::enabled ? "cannot write " + trace_path : "built without PN_TRACE, no trace written") << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
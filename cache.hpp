@@ -0,0 +1,246 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace pn {
+  /// Address of a per-type static, identifies a generator type without RTTI
+  template<typename Gen>
+  inline const void* type_tag() {
+    static const char tag = 0;
+    return &tag;
+  }
+
+  /// Hashes the bytes of a list of parameters (zoom, octaves, persistance...) into one 64-bit value, FNV-1a
+  inline uint64_t hash_params() { return 14695981039346656037ull; }
+
+  template<typename P, typename... Rest>
+  inline uint64_t hash_params(const P& param, const Rest&... rest) {
+    uint64_t h = hash_params(rest...);
+    unsigned char bytes[sizeof(P)];
+    std::memcpy(bytes, &param, sizeof(P));
+    for (const unsigned char byte : bytes) {
+      h = (h ^ byte) * 1099511628211ull;
+    }
+    return h;
+  }
+
+  /**
+   * Identifies the contents of a tile: what generated it (type, seed), how (operation and fractal parameters hashed
+   * with hash_params) and where (tile coordinates, tz = 0 for 2D tiles).
+   */
+  struct tile_key {
+    const void* type;
+    uint64_t seed;
+    uint64_t params;
+    int64_t tx, ty, tz;
+
+    bool operator==(const tile_key& rhs) const {
+      return type == rhs.type && seed == rhs.seed && params == rhs.params && tx == rhs.tx && ty == rhs.ty && tz == rhs.tz;
+    }
+  };
+
+  /// Builds the key of a tile generated by Gen
+  template<typename Gen>
+  inline tile_key make_tile_key(const uint64_t seed, const uint64_t params, const int64_t tx, const int64_t ty, const int64_t tz = 0) {
+    return {type_tag<Gen>(), seed, params, tx, ty, tz};
+  }
+
+  /// 64-bit hash of a tile key
+  inline uint64_t hash_key(const tile_key& k) {
+    uint64_t h = (uint64_t) (uintptr_t) k.type;
+    for (const uint64_t v : {k.seed, k.params, (uint64_t) k.tx, (uint64_t) k.ty, (uint64_t) k.tz}) {
+      // splitmix64 step, mixes every input bit into the high bits used for shard selection
+      h = (h ^ v) + 0x9E3779B97F4A7C15ull;
+      h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+      h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+      h ^= h >> 31;
+    }
+    return h;
+  }
+
+  struct tile_key_hash {
+    size_t operator()(const tile_key& k) const { return (size_t) hash_key(k); }
+  };
+
+  /**
+   * Cache of generated tiles with a byte budget and CLOCK eviction.
+   *
+   * Tiles are split over shards by key hash, each shard has its own mutex and a budget of byte_budget / num_shards,
+   * so concurrent readers only contend when they hit the same shard and then only for a map lookup. A hit marks the
+   * tile as referenced; eviction sweeps a clock hand over the shard, clearing the mark of referenced tiles and
+   * evicting the first unreferenced one. Buffers are handed out as shared pointers, an evicted tile stays valid for
+   * whoever still holds it.
+   */
+  template<typename T>
+  class basic_tile_cache {
+  public:
+    using buffer = std::shared_ptr<const std::vector<T>>;
+
+    explicit basic_tile_cache(const size_t byte_budget, const size_t num_shards = 16) :
+      shards(std::max<size_t>(1, num_shards)) {
+      for (shard& s : shards) {
+        s.budget = byte_budget / shards.size();
+      }
+    }
+
+    basic_tile_cache(const basic_tile_cache&) = delete;
+    basic_tile_cache& operator=(const basic_tile_cache&) = delete;
+
+    /// Returns the cached tile or nullptr
+    buffer find(const tile_key& key) {
+      shard& s = shard_of(key);
+      std::unique_lock<std::mutex> lk(s.mut);
+      const auto it = s.index.find(key);
+      if (it == s.index.end()) {
+        miss_count++;
+        return nullptr;
+      }
+      slot& e = s.slots[it->second];
+      e.referenced = true;
+      hit_count++;
+      return e.data;
+    }
+
+    /// Stores a tile, evicting others if the shard is over budget. If the key is already cached that tile is kept and returned
+    buffer insert(const tile_key& key, std::vector<T>&& data) {
+      buffer tile = std::make_shared<const std::vector<T>>(std::move(data));
+      const size_t bytes = cost(*tile);
+      shard& s = shard_of(key);
+      std::unique_lock<std::mutex> lk(s.mut);
+      const auto it = s.index.find(key);
+      if (it != s.index.end()) {
+        return s.slots[it->second].data;
+      }
+      if (bytes > s.budget) {
+        return tile; // Never fits, hand it out uncached
+      }
+      while (s.bytes + bytes > s.budget) {
+        evict_one(s);
+      }
+      size_t index;
+      if (!s.free.empty()) {
+        index = s.free.back();
+        s.free.pop_back();
+      } else {
+        index = s.slots.size();
+        s.slots.emplace_back();
+      }
+      s.slots[index] = slot{key, tile, bytes, false, true};
+      s.index.emplace(key, index);
+      s.bytes += bytes;
+      return tile;
+    }
+
+    /**
+     * Returns the cached tile or generates it with fill(T* out) into a buffer of count elements and caches it.
+     * fill runs without any lock held; two threads missing on the same key may both generate it, the first insert wins.
+     */
+    template<typename Fill>
+    buffer get_or_compute(const tile_key& key, const size_t count, const Fill& fill) {
+      buffer tile = find(key);
+      if (tile) { return tile; }
+      std::vector<T> data(count);
+      fill(data.data());
+      return insert(key, std::move(data));
+    }
+
+    /// Drops every tile, the counters are kept
+    void clear() {
+      for (shard& s : shards) {
+        std::unique_lock<std::mutex> lk(s.mut);
+        s.index.clear();
+        s.slots.clear();
+        s.free.clear();
+        s.hand = 0;
+        s.bytes = 0;
+      }
+    }
+
+    /// Number of lookups that found their tile
+    uint64_t hits() const { return hit_count.load(); }
+
+    /// Number of lookups that did not find their tile
+    uint64_t misses() const { return miss_count.load(); }
+
+    /// Number of tiles evicted to stay within the budget
+    uint64_t evictions() const { return eviction_count.load(); }
+
+    /// Bytes currently accounted to cached tiles
+    size_t size_bytes() {
+      size_t total = 0;
+      for (shard& s : shards) {
+        std::unique_lock<std::mutex> lk(s.mut);
+        total += s.bytes;
+      }
+      return total;
+    }
+
+  private:
+    struct slot {
+      tile_key key;
+      buffer data;
+      size_t bytes;
+      bool referenced;
+      bool used;
+    };
+
+    struct shard {
+      std::mutex mut;
+      std::unordered_map<tile_key, size_t, tile_key_hash> index;
+      std::vector<slot> slots;
+      std::vector<size_t> free;
+      size_t hand = 0;
+      size_t bytes = 0;
+      size_t budget = 0;
+    };
+
+    std::vector<shard> shards;
+    std::atomic<uint64_t> hit_count{0};
+    std::atomic<uint64_t> miss_count{0};
+    std::atomic<uint64_t> eviction_count{0};
+
+    shard& shard_of(const tile_key& key) {
+      // The low bits feed the map buckets, take the shard from the high ones
+      return shards[(hash_key(key) >> 32) % shards.size()];
+    }
+
+    /// Memory held by a tile, elements plus bookkeeping
+    static size_t cost(const std::vector<T>& data) {
+      return data.size() * sizeof(T) + sizeof(slot) + sizeof(std::vector<T>);
+    }
+
+    /// Advances the clock hand until an unreferenced tile is found and evicts it, the shard must not be empty
+    void evict_one(shard& s) {
+      while (true) {
+        if (s.hand >= s.slots.size()) { s.hand = 0; }
+        slot& e = s.slots[s.hand];
+        if (e.used && e.referenced) {
+          e.referenced = false;
+        } else if (e.used) {
+          s.index.erase(e.key);
+          s.bytes -= e.bytes;
+          e = slot{};
+          s.free.push_back(s.hand);
+          eviction_count++;
+          s.hand++;
+          return;
+        }
+        s.hand++;
+      }
+    }
+  };
+
+  using tile_cache = basic_tile_cache<double>;
+  using tile_cachef = basic_tile_cache<float>;
+}
+
+#endif // CACHE_H
@@ -0,0 +1,252 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "noise.hpp"
+
+namespace pn {
+  /// Point of a colour ramp, components are display (gamma encoded) values in [0, 1]
+  struct color_stop {
+    double position; // In [0, 1] across the mapped range [lo, hi]
+    float r, g, b, a;
+  };
+
+  /// Byte order of the packed 8-bit pixels
+  enum class pixel_order {
+    argb, // 0xAARRGGBB words, SDL_PIXELFORMAT_ARGB8888 (the explorer's window surface)
+    rgba  // Bytes R, G, B, A in memory, GL_RGBA with GL_UNSIGNED_BYTE
+  };
+
+  /**
+   * Colour mapping of noise buffers into RGBA8, R16 or RGBA32F textures through a colour ramp.
+   *
+   * The ramp and the gamma are baked once into lookup tables of lut_size entries spread over [lo, hi]: packed pixels
+   * for RGBA8, taken from the nearest entry, and float colours for R16 and RGBA32F, interpolated linearly between the
+   * two entries around a value. Stops are interpolated in linear light (decoded with gamma) and the result encoded
+   * again, so a black to white ramp with gamma 2 gives sqrt((v - lo) / (hi - lo)). Values outside [lo, hi] and NaN
+   * are clamped, NaN to lo.
+   *
+   * Converting a value is a subtraction, a multiplication, a clamp and a table lookup, with no pow or sqrt per sample.
+   * With AVX2 the conversions do 8 values per step (the positions in float lanes, gathers into the tables) and are
+   * bit-identical to the scalar ones unless those are built with FMA contraction. A map is immutable once built and
+   * can be shared by every thread of a pool.
+   */
+  template<typename T>
+  class basic_color_map {
+  public:
+    /// Default number of table entries, the 8-bit pixels are within one step of the exact ramp for smooth ramps
+    static const size_t default_size = 4096;
+
+    /**
+     * @param ramp Stops sorted by position, the first and last colours extend to the ends of the range
+     * @param lo, hi Noise values mapped onto the positions 0 and 1
+     * @param gamma Display gamma of the stops and the output, 1 interpolates the stops as given
+     * @param order Byte order of the RGBA8 pixels
+     * @param size Number of table entries, at least 2
+     */
+    basic_color_map(const std::vector<color_stop>& ramp, const T lo = -1, const T hi = 1, const double gamma = 1.0,
+                    const pixel_order order = pixel_order::argb, const size_t size = default_size) :
+      lo(lo), scale(T(std::max<size_t>(size, 2) - 1) / (hi - lo)), last((float) (std::max<size_t>(size, 2) - 1)),
+      packed(std::max<size_t>(size, 2)), channels(4 * (std::max<size_t>(size, 2) + 1)) {
+      const size_t n = packed.size();
+      for (size_t i = 0; i < n; i++) {
+        float c[4];
+        sample(ramp, gamma, (double) i / (n - 1), c);
+        std::copy(c, c + 4, &channels[4 * i]);
+        uint8_t bytes[4];
+        for (int k = 0; k < 4; k++) { bytes[k] = (uint8_t) (std::min(std::max(c[k], 0.0f), 1.0f) * 255.0f + 0.5f); }
+        packed[i] = pack(bytes, order);
+      }
+      std::copy(&channels[4 * (n - 1)], &channels[4 * n], &channels[4 * n]); // So that the entry after the last one exists
+    }
+
+    /// Black to white
+    static std::vector<color_stop> gray() {
+      return {{0.0, 0.0f, 0.0f, 0.0f, 1.0f}, {1.0, 1.0f, 1.0f, 1.0f, 1.0f}};
+    }
+
+    /// Deep water, shallow water, sand, grass, rock and snow, sea level at position 0.5
+    static std::vector<color_stop> terrain() {
+      return {
+        {0.00, 0.00f, 0.05f, 0.30f, 1.0f},
+        {0.48, 0.10f, 0.35f, 0.70f, 1.0f},
+        {0.50, 0.85f, 0.80f, 0.55f, 1.0f},
+        {0.55, 0.25f, 0.60f, 0.20f, 1.0f},
+        {0.75, 0.45f, 0.40f, 0.35f, 1.0f},
+        {0.90, 0.95f, 0.95f, 0.95f, 1.0f},
+        {1.00, 1.00f, 1.00f, 1.00f, 1.0f}
+      };
+    }
+
+    /// Packed pixel of a value
+    inline uint32_t rgba8(const T value) const { return packed[nearest(position(value))]; }
+
+    /// Packed pixels of count values
+    void rgba8(const T* values, uint32_t* out, const size_t count) const {
+      size_t n = 0;
+#ifdef PN_SIMD_X86
+      if (pn::simd::detect() == pn::simd::level::avx2) { n = rgba8_avx2(values, out, count); }
+#endif
+      for (; n < count; n++) { out[n] = rgba8(values[n]); }
+    }
+
+    /// First channel of count values as 16-bit unsigned normalized texels, the gray level with gray()
+    void r16(const T* values, uint16_t* out, const size_t count) const {
+      size_t n = 0;
+#ifdef PN_SIMD_X86
+      if (pn::simd::detect() == pn::simd::level::avx2) { n = r16_avx2(values, out, count); }
+#endif
+      for (; n < count; n++) {
+        const float t = position(values[n]);
+        const int i = (int) t;
+        out[n] = (uint16_t) (lerp(t - (float) i, channels[4 * i], channels[4 * i + 4]) * 65535.0f + 0.5f);
+      }
+    }
+
+    /// RGBA float colours of count values, 4 floats per value
+    void rgba32f(const T* values, float* out, const size_t count) const {
+      size_t n = 0;
+#ifdef PN_SIMD_X86
+      if (pn::simd::detect() == pn::simd::level::avx2) { n = rgba32f_avx2(values, out, count); }
+#endif
+      for (; n < count; n++) {
+        const float t = position(values[n]);
+        const int i = (int) t;
+        for (int k = 0; k < 4; k++) { out[4 * n + k] = lerp(t - (float) i, channels[4 * i + k], channels[4 * i + 4 + k]); }
+      }
+    }
+
+  private:
+    T lo;
+    T scale;
+    float last; // Position of the last entry
+
+    /// 8-bit pixel of each entry
+    std::vector<uint32_t> packed;
+
+    /// RGBA of each entry and a copy of the last one
+    std::vector<float> channels;
+
+    /// Table position of a value in [0, last], NaN at 0
+    inline float position(const T value) const {
+      const float t = (float) ((value - lo) * scale);
+      return std::min(t > 0.0f ? t : 0.0f, last);
+    }
+
+    static inline int nearest(const float t) { return (int) (t + 0.5f); }
+
+    static inline float lerp(const float w, const float a, const float b) { return a + w * (b - a); }
+
+    static uint32_t pack(const uint8_t* bytes, const pixel_order order) {
+      if (order == pixel_order::argb) {
+        return ((uint32_t) bytes[3] << 24) | ((uint32_t) bytes[0] << 16) | ((uint32_t) bytes[1] << 8) | bytes[2];
+      }
+      uint32_t word;
+      std::memcpy(&word, bytes, 4);
+      return word;
+    }
+
+    /// Colour of the ramp at t in [0, 1], interpolated in linear light
+    static void sample(const std::vector<color_stop>& ramp, const double gamma, const double t, float* c) {
+      if (ramp.empty()) {
+        std::fill(c, c + 4, 0.0f);
+        return;
+      }
+      size_t j = 0;
+      while (j < ramp.size() && ramp[j].position < t) { j++; }
+      const color_stop& b = ramp[std::min(j, ramp.size() - 1)];
+      const color_stop& a = ramp[j == 0 ? 0 : j - 1];
+      const double span = b.position - a.position;
+      const double w = span > 0.0 ? std::min(std::max((t - a.position) / span, 0.0), 1.0) : 1.0;
+      const float ca[4] = {a.r, a.g, a.b, a.a};
+      const float cb[4] = {b.r, b.g, b.b, b.a};
+      for (int k = 0; k < 4; k++) {
+        if (k == 3) { // Alpha is linear
+          c[k] = (float) (ca[k] + w * (cb[k] - ca[k]));
+          continue;
+        }
+        const double la = std::pow(std::max<double>(ca[k], 0.0), gamma);
+        const double lb = std::pow(std::max<double>(cb[k], 0.0), gamma);
+        c[k] = (float) std::pow(la + w * (lb - la), 1.0 / gamma);
+      }
+    }
+
+#ifdef PN_SIMD_X86
+    /// position() of 8 values, converted to float like the scalar path
+    PN_TARGET("avx2") inline __m256 position_avx2(const double* v) const {
+      const __m256d l = _mm256_set1_pd(lo), s = _mm256_set1_pd(scale);
+      const __m128 a = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(v), l), s));
+      const __m128 b = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(v + 4), l), s));
+      return clamp_avx2(_mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1));
+    }
+
+    PN_TARGET("avx2") inline __m256 position_avx2(const float* v) const {
+      return clamp_avx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(v), _mm256_set1_ps(lo)), _mm256_set1_ps(scale)));
+    }
+
+    /// max returns its second operand for NaN, so NaN goes to 0 as in position()
+    PN_TARGET("avx2") inline __m256 clamp_avx2(const __m256 t) const {
+      return _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(last));
+    }
+
+    /// Packed pixels 8 values at a time, returns the number of values processed
+    PN_TARGET("avx2") size_t rgba8_avx2(const T* values, uint32_t* out, const size_t count) const {
+      const __m256 half = _mm256_set1_ps(0.5f);
+      size_t n = 0;
+      for (; n + 8 <= count; n += 8) {
+        const __m256i i = _mm256_cvttps_epi32(_mm256_add_ps(position_avx2(values + n), half));
+        _mm256_storeu_si256((__m256i*) (out + n), _mm256_i32gather_epi32((const int*) packed.data(), i, 4));
+      }
+      return n;
+    }
+
+    /// 16-bit texels 8 values at a time, returns the number of values processed
+    PN_TARGET("avx2") size_t r16_avx2(const T* values, uint16_t* out, const size_t count) const {
+      const __m256 range = _mm256_set1_ps(65535.0f), half = _mm256_set1_ps(0.5f);
+      size_t n = 0;
+      for (; n + 8 <= count; n += 8) {
+        const __m256 t = position_avx2(values + n);
+        const __m256i i = _mm256_cvttps_epi32(t);
+        const __m256 w = _mm256_sub_ps(t, _mm256_cvtepi32_ps(i));
+        const __m256i at = _mm256_slli_epi32(i, 2);
+        const __m256 a = _mm256_i32gather_ps(channels.data(), at, 4);
+        const __m256 b = _mm256_i32gather_ps(channels.data() + 4, at, 4);
+        const __m256 r = _mm256_add_ps(a, _mm256_mul_ps(w, _mm256_sub_ps(b, a)));
+        const __m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(r, range), half));
+        // Packs within each 128-bit half, then moves the two low quarters together
+        const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(q, q), 0x08);
+        _mm_storeu_si128((__m128i*) (out + n), _mm256_castsi256_si128(p));
+      }
+      return n;
+    }
+
+    /// RGBA float colours 8 values at a time, one 4-float entry pair per value, returns the number of values processed
+    PN_TARGET("avx2") size_t rgba32f_avx2(const T* values, float* out, const size_t count) const {
+      alignas(32) int index[8];
+      alignas(32) float weight[8];
+      size_t n = 0;
+      for (; n + 8 <= count; n += 8) {
+        const __m256 t = position_avx2(values + n);
+        const __m256i i = _mm256_cvttps_epi32(t);
+        _mm256_store_si256((__m256i*) index, i);
+        _mm256_store_ps(weight, _mm256_sub_ps(t, _mm256_cvtepi32_ps(i)));
+        for (int k = 0; k < 8; k++) {
+          const __m128 a = _mm_loadu_ps(&channels[4 * index[k]]);
+          const __m128 b = _mm_loadu_ps(&channels[4 * index[k] + 4]);
+          _mm_storeu_ps(out + 4 * (n + k), _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_sub_ps(b, a))));
+        }
+      }
+      return n;
+    }
+#endif
+  };
+
+  using color_map = basic_color_map<double>;
+  using color_mapf = basic_color_map<float>;
+}
+
+#endif // COLOR_H
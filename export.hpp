@@ -0,0 +1,328 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "noise.hpp"
+#include "pool.hpp"
+
+namespace pn {
+  /// Encoding of the samples of a field file
+  enum class sample_format : uint32_t {
+    float32 = 0, // The value as an IEEE 754 single
+    uint16 = 1   // [lo, hi] mapped linearly onto [0, 65535], clamped
+  };
+
+  /**
+   * Header at the start of a field file. Every value is stored in the byte order of the machine that wrote it
+   * (little-endian in practice).
+   *
+   * File layout:
+   *   [0, 128)                 field_header
+   *   [128, 128 + num tiles)   One byte per tile, 1 once the tile is written. Tiles are numbered x fastest, then y, then z
+   *   [data_offset, end)       nx * ny * nz samples, x fastest, then y, then z, no padding. data_offset is a multiple of 4096
+   */
+  struct field_header {
+    char magic[8];                   // "PNFIELD\0"
+    uint32_t version;                // 1
+    uint32_t format;                 // sample_format
+    uint64_t nx, ny, nz;             // Number of samples along each axis, nz = 1 for 2D fields
+    uint32_t tile_x, tile_y, tile_z; // Tile size in samples
+    uint32_t dims;                   // 2 or 3
+    double x0, y0, z0;               // Noise space position of sample (0, 0, 0)
+    double dx, dy, dz;               // Spacing between samples in noise space
+    double lo, hi;                   // Value range of the uint16 encoding
+    uint64_t data_offset;            // Byte offset of the first sample
+  };
+  static_assert(sizeof(field_header) == 128, "field_header must be 128 bytes");
+
+  /**
+   * Generates a 2D or 3D field tile by tile on a pool and writes it straight into a memory-mapped field file.
+   *
+   * The field is never held in memory: each worker fills one tile into its own buffer and encodes it into the mapped
+   * file, the page cache writes it back. Every checkpoint_tiles finished tiles the data is synced to disk and only
+   * then are those tiles marked as done in the file, so after an interruption (crash, kill, power loss) the writer
+   * reopens the file and only generates the tiles that are not marked. Resuming requires the same grid, format, tile
+   * size and range; a file holding another field is left untouched and reported as an error.
+   *
+   * Errors are reported through ok() and error(). POSIX only (mmap).
+   */
+  template<typename T>
+  class basic_field_writer {
+  public:
+    using grid2 = pn::basic_grid2<T>;
+    using grid3 = pn::basic_grid3<T>;
+
+    /**
+     * Opens or creates the file for a 3D field.
+     * @param path Output file
+     * @param grid Sample points of the field, strides are ignored
+     * @param format Sample encoding
+     * @param tile_x, tile_y, tile_z Tile size in samples
+     * @param lo, hi Value range mapped onto the uint16 encoding, hi > lo
+     * @param resume Continues an unfinished file of the same field instead of starting over
+     */
+    basic_field_writer(const std::string& path, const grid3& grid, const sample_format format, const size_t tile_x,
+                       const size_t tile_y, const size_t tile_z, const T lo = -1, const T hi = 1, const bool resume = true) {
+      init(grid, 3, format, tile_x, tile_y, tile_z, lo, hi);
+      open(path, resume);
+    }
+
+    /**
+     * Opens or creates the file for a 2D field, see the 3D constructor. The tiles handed to fill have nz = 1 and z0 = 0,
+     * fill is expected to evaluate 2D noise at (x, y).
+     */
+    basic_field_writer(const std::string& path, const grid2& grid, const sample_format format, const size_t tile_x,
+                       const size_t tile_y, const T lo = -1, const T hi = 1, const bool resume = true) {
+      init(grid3{grid.x0, grid.y0, 0, grid.dx, grid.dy, 1, grid.nx, grid.ny, 1}, 2, format, tile_x, tile_y, 1, lo, hi);
+      open(path, resume);
+    }
+
+    basic_field_writer(const basic_field_writer&) = delete;
+    basic_field_writer& operator=(const basic_field_writer&) = delete;
+
+    ~basic_field_writer() {
+      if (map != nullptr) { munmap(map, file_size); }
+      if (fd >= 0) { close(fd); }
+    }
+
+    /// False once an error occurred, see error()
+    bool ok() const { return failure.empty(); }
+
+    /// Description of the first error, empty if none
+    const std::string& error() const { return failure; }
+
+    /// Header of the file
+    const field_header& layout() const { return header; }
+
+    /// Number of tiles of the field
+    size_t num_tiles() const { return tiles_x * tiles_y * tiles_z; }
+
+    /// Number of tiles generated and synced to disk, including those of previous runs
+    size_t tiles_done() const { return done_count; }
+
+    /// Sample points of a tile, with tight strides
+    grid3 tile_grid(const size_t tile) const {
+      const size_t i0 = (tile % tiles_x) * header.tile_x;
+      const size_t j0 = (tile / tiles_x % tiles_y) * header.tile_y;
+      const size_t k0 = (tile / (tiles_x * tiles_y)) * header.tile_z;
+      return grid3{T(header.x0 + i0 * header.dx), T(header.y0 + j0 * header.dy), T(header.z0 + k0 * header.dz),
+                   T(header.dx), T(header.dy), T(header.dz),
+                   std::min<size_t>(header.tile_x, header.nx - i0),
+                   std::min<size_t>(header.tile_y, header.ny - j0),
+                   std::min<size_t>(header.tile_z, header.nz - k0)};
+    }
+
+    /**
+     * Generates every tile not yet marked as done. fill(const grid3& tile, T* out) writes the samples of a tile as
+     * out[k * tile.slice_stride + j * tile.stride + i] and is called concurrently from the workers.
+     * progress(tiles_done, num_tiles) is called after every checkpoint, returning false stops the export after the
+     * tiles in flight (they are synced, the file can be resumed).
+     * @return True if the whole field is written
+     */
+    template<typename Fill, typename Progress>
+    bool run(pool& workers, const Fill& fill, const Progress& progress, const size_t checkpoint_tiles = 64) {
+      if (!ok()) { return false; }
+      const uint8_t* marks = (const uint8_t*) map + sizeof(field_header);
+      std::vector<size_t> pending;
+      for (size_t t = 0; t < num_tiles(); t++) {
+        if (marks[t] == 0) { pending.push_back(t); }
+      }
+      std::vector<std::vector<T>> buffers(workers.size());
+      std::vector<size_t> finished;
+      std::mutex finished_mut;
+      std::mutex checkpoint_mut;
+      std::atomic<bool> stop{false};
+      // Syncs a batch of finished tiles and marks them, one checkpoint at a time
+      auto commit = [&](std::vector<size_t>& batch) {
+        std::unique_lock<std::mutex> lk(checkpoint_mut);
+        if (!checkpoint(batch) || !progress(done_count, num_tiles())) { stop = true; }
+      };
+      workers.run(pending.size(), [&](size_t task, size_t worker) {
+        if (stop.load()) { return; }
+        const size_t tile = pending[task];
+        const grid3 grid = tile_grid(tile);
+        std::vector<T>& buffer = buffers[worker];
+        buffer.resize(grid.nx * grid.ny * grid.nz);
+        fill(grid, buffer.data());
+        store(tile, grid, buffer.data());
+        std::vector<size_t> batch;
+        {
+          std::unique_lock<std::mutex> lk(finished_mut);
+          finished.push_back(tile);
+          if (finished.size() < checkpoint_tiles) { return; }
+          batch.swap(finished);
+        }
+        commit(batch);
+      });
+      if (!finished.empty()) { commit(finished); }
+      return ok() && done_count == num_tiles();
+    }
+
+    /// Generates every tile not yet marked as done, without progress reports
+    template<typename Fill>
+    bool run(pool& workers, const Fill& fill) {
+      return run(workers, fill, [](size_t, size_t) { return true; });
+    }
+
+  private:
+    field_header header;
+    size_t tiles_x = 0, tiles_y = 0, tiles_z = 0;
+    size_t done_count = 0;
+    int fd = -1;
+    void* map = nullptr;
+    uint64_t file_size = 0;
+    std::string failure;
+
+    bool fail(const std::string& what) {
+      if (failure.empty()) { failure = what; }
+      return false;
+    }
+
+    size_t sample_size() const { return header.format == (uint32_t) sample_format::uint16 ? 2 : 4; }
+
+    void init(const grid3& grid, const uint32_t dims, const sample_format format, const size_t tile_x,
+              const size_t tile_y, const size_t tile_z, const T lo, const T hi) {
+      std::memset(&header, 0, sizeof(header));
+      std::memcpy(header.magic, "PNFIELD", 8);
+      header.version = 1;
+      header.format = (uint32_t) format;
+      header.nx = grid.nx;
+      header.ny = grid.ny;
+      header.nz = grid.nz;
+      header.tile_x = (uint32_t) std::max<size_t>(1, std::min<size_t>(tile_x, grid.nx));
+      header.tile_y = (uint32_t) std::max<size_t>(1, std::min<size_t>(tile_y, grid.ny));
+      header.tile_z = (uint32_t) std::max<size_t>(1, std::min<size_t>(tile_z, grid.nz));
+      header.dims = dims;
+      header.x0 = grid.x0;
+      header.y0 = grid.y0;
+      header.z0 = grid.z0;
+      header.dx = grid.dx;
+      header.dy = grid.dy;
+      header.dz = grid.dz;
+      header.lo = lo;
+      header.hi = hi;
+      tiles_x = (header.nx + header.tile_x - 1) / header.tile_x;
+      tiles_y = (header.ny + header.tile_y - 1) / header.tile_y;
+      tiles_z = (header.nz + header.tile_z - 1) / header.tile_z;
+      header.data_offset = (sizeof(field_header) + num_tiles() + 4095) / 4096 * 4096;
+    }
+
+    void open(const std::string& path, const bool resume) {
+      if (header.format > (uint32_t) sample_format::uint16) { fail("unknown sample format"); return; }
+      if (header.nx == 0 || header.ny == 0 || header.nz == 0) { fail("empty field"); return; }
+      if (header.format == (uint32_t) sample_format::uint16 && !(header.hi > header.lo)) { fail("empty value range"); return; }
+      file_size = header.data_offset + header.nx * header.ny * header.nz * sample_size();
+      fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd < 0) { fail("cannot open " + path); return; }
+      struct stat st;
+      if (fstat(fd, &st) != 0) { fail("cannot stat " + path); return; }
+      field_header existing;
+      const bool found = resume && st.st_size > 0;
+      if (found) {
+        if (pread(fd, &existing, sizeof(existing), 0) != (ssize_t) sizeof(existing) ||
+            std::memcmp(&existing, &header, sizeof(header)) != 0 || (uint64_t) st.st_size != file_size) {
+          fail(path + " holds a different field, not resuming");
+          return;
+        }
+      } else {
+        // Sparse file, the tile marks read as zero until written
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t) file_size) != 0) { fail("cannot resize " + path); return; }
+        if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) { fail("cannot write " + path); return; }
+      }
+      map = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED) {
+        map = nullptr;
+        fail("cannot map " + path);
+        return;
+      }
+      const uint8_t* marks = (const uint8_t*) map + sizeof(field_header);
+      done_count = (size_t) std::count(marks, marks + num_tiles(), 1);
+    }
+
+    /// Index in the data region of the first sample of row j of slice k of a tile
+    uint64_t row_offset(const size_t tile, const size_t j, const size_t k) const {
+      const size_t i0 = (tile % tiles_x) * header.tile_x;
+      const size_t j0 = (tile / tiles_x % tiles_y) * header.tile_y;
+      const size_t k0 = (tile / (tiles_x * tiles_y)) * header.tile_z;
+      return ((uint64_t) (k0 + k) * header.ny + (j0 + j)) * header.nx + i0;
+    }
+
+    /// Encodes the samples of a tile into the mapped file
+    void store(const size_t tile, const grid3& grid, const T* samples) {
+      const T lo = T(header.lo);
+      const T scale = T(65535.0 / (header.hi - header.lo));
+      uint8_t* data = (uint8_t*) map + header.data_offset;
+      for (size_t k = 0; k < grid.nz; k++) {
+        for (size_t j = 0; j < grid.ny; j++) {
+          const T* src = samples + k * grid.slice_stride + j * grid.stride;
+          const uint64_t offset = row_offset(tile, j, k);
+          if (header.format == (uint32_t) sample_format::float32) {
+            float* dst = (float*) data + offset;
+            for (size_t i = 0; i < grid.nx; i++) { dst[i] = (float) src[i]; }
+          } else {
+            uint16_t* dst = (uint16_t*) data + offset;
+            for (size_t i = 0; i < grid.nx; i++) {
+              const T v = std::min(std::max((src[i] - lo) * scale, T(0)), T(65535));
+              dst[i] = (uint16_t) (v + T(0.5));
+            }
+          }
+        }
+      }
+    }
+
+    /// File byte ranges of the rows of the tiles, starting on page boundaries as msync requires, sorted and merged
+    std::vector<std::pair<uint64_t, uint64_t>> tile_ranges(const std::vector<size_t>& batch) const {
+      const uint64_t page = (uint64_t) sysconf(_SC_PAGESIZE);
+      std::vector<std::pair<uint64_t, uint64_t>> ranges;
+      for (const size_t tile : batch) {
+        const grid3 grid = tile_grid(tile);
+        for (size_t k = 0; k < grid.nz; k++) {
+          for (size_t j = 0; j < grid.ny; j++) {
+            const uint64_t begin = header.data_offset + row_offset(tile, j, k) * sample_size();
+            ranges.push_back({begin / page * page, begin + grid.nx * sample_size()});
+          }
+        }
+      }
+      std::sort(ranges.begin(), ranges.end());
+      std::vector<std::pair<uint64_t, uint64_t>> merged;
+      for (const auto& r : ranges) {
+        if (!merged.empty() && r.first <= merged.back().second) {
+          merged.back().second = std::max(merged.back().second, r.second);
+        } else {
+          merged.push_back(r);
+        }
+      }
+      return merged;
+    }
+
+    /// Syncs the samples of the batch's tiles to disk, then marks the tiles as done and syncs the marks
+    bool checkpoint(std::vector<size_t>& batch) {
+      if (batch.empty()) { return ok(); }
+      uint8_t* base = (uint8_t*) map;
+      for (const auto& r : tile_ranges(batch)) {
+        if (msync(base + r.first, r.second - r.first, MS_SYNC) != 0) { return fail("cannot sync the samples"); }
+      }
+      for (const size_t tile : batch) { base[sizeof(field_header) + tile] = 1; }
+      if (msync(base, header.data_offset, MS_SYNC) != 0) { return fail("cannot sync the tile marks"); }
+      done_count += batch.size();
+      batch.clear();
+      return true;
+    }
+  };
+
+  using field_writer = basic_field_writer<double>;
+  using field_writerf = basic_field_writer<float>;
+}
+
+#endif // EXPORT_H
@@ -0,0 +1,555 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <random>
+#include <array>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include "noise.hpp"
+
+namespace pn {
+  /**
+   * Fixed-point noise: integer lattice hashing, integer gradients and fixed-point fades, so the noise of a point is
+   * the same bits on every build regardless of compiler flags or FMA contraction. Only the conversion of the real
+   * coordinates (a floor, a subtraction and a multiplication by a power of two) and of the result (a multiplication
+   * by a power of two) touch floating point, and both are exact.
+   *
+   * Coordinates and values are Q14 numbers, one = 1 << 14 is a lattice cell or a noise value of 1. Every
+   * intermediate of the Perlin noise fits a 32-bit lane, so the AVX2 kernels evaluate 8 points per register; the
+   * simplex noise needs 64-bit intermediates for the skew and stays scalar.
+   *
+   * The generators are built like their floating point counterparts from the same seed, so perlin::improved<> and
+   * fixed::improved<>, simplex::tables<> and fixed::tables<> draw the same gradients and permutations and differ only
+   * by the quantization, below 2e-3 except within a Q14 step of the faces across which 3D simplex::tables jumps.
+   */
+  namespace fixed {
+    /// Fractional bits of the Q14 numbers
+    static const int frac_bits = 14;
+    static const int32_t one = 1 << frac_bits;
+    static const int32_t frac_mask = one - 1;
+
+    /// Largest difference to the floating point noise at the same Q14 coordinates, measured below 2e-3, doubled
+    static const double quantization = 4e-3;
+
+    /// Splits a real coordinate into its lattice cell and its Q14 offset inside the cell, exact
+    template<typename T>
+    inline void split(const T v, int& cell, int32_t& frac) {
+      const T c = std::floor(v);
+      cell = (int) c;
+      frac = (int32_t) std::floor((v - c) * T(one));
+      if (frac >= one) { // v - c rounded up to 1 for a v just below an integer
+        cell += 1;
+        frac -= one;
+      }
+    }
+
+    /// Q14 coordinate of a real one, see split
+    template<typename T>
+    inline int64_t from_real(const T v) {
+      int cell;
+      int32_t frac;
+      split(v, cell, frac);
+      return (int64_t) cell * one + frac;
+    }
+
+    /// Real value of a Q14 number, exact
+    template<typename T>
+    inline T to_real(const int32_t v) { return T(v) * T(1.0 / one); }
+
+    /// Quintic fade 6t^5 - 15t^4 + 10t^3 of t in [0, one), Q14; (6t - 15) and the inner sum are kept in Q12 so that no product exceeds 31 bits
+    inline int32_t fade(const int32_t t) {
+      const int32_t t3 = (((t * t) >> frac_bits) * t) >> frac_bits;
+      const int32_t inner = ((t * ((6 * t >> 2) - 15 * 4096)) >> frac_bits) + 10 * 4096;
+      return (t3 * inner) >> 12;
+    }
+
+    /// a + w (b - a) with the weight w in [0, one]
+    inline int32_t lerp(const int32_t w, const int32_t a, const int32_t b) {
+      return a + ((w * (b - a)) >> frac_bits);
+    }
+
+    inline int32_t clamp(const int32_t v) { return std::min(std::max(v, -one), one); }
+
+    /**
+     * Improved Perlin noise in fixed point, the lattice, gradients and hashing of perlin::basic_improved.
+     * T is the scalar type of the real interface, the noise itself is computed in integers.
+     */
+    template<typename T, int num_grads = 256, typename Hash = pn::hash::table<num_grads>>
+    class basic_improved : public pn::basic_generator<T> {
+    public:
+      using base = pn::basic_generator<T>;
+      using typename base::grid2;
+      using typename base::grid3;
+      using typename base::derivative2;
+      using typename base::derivative3;
+
+    protected:
+      using base::fill_batched;
+
+    private:
+      /// Hash and gradients of a seed, interned and shared by every generator built with it, see pn::shared
+      struct block {
+        /// Lattice hash, selects the gradient of a lattice point
+        Hash hash;
+
+        /// Components of the 16 (padded) edge gradients of perlin::basic_improved
+        std::array<int32_t, 16> grads3_x{{1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 1, -1, 0, 0}};
+        std::array<int32_t, 16> grads3_y{{1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, 1, -1, -1}};
+        std::array<int32_t, 16> grads3_z{{0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1, 0, 0, 1, -1}};
+      };
+
+      shared::handle<block> lookup;
+
+      /// Draws the hash from the engine exactly like perlin::basic_improved
+      static void build(block& t, const uint64_t seed) {
+        std::mt19937 engine(seed);
+        t.hash = Hash(engine, 4);
+      }
+
+      static const int grads_mask = 4 - 1;
+      static const int grads3_mask = 16 - 1;
+
+      /// perlin::basic_improved adds 0.1 to the 2D coordinates so that integer lines are not zero
+      static const int32_t skew = 1638;
+
+      /// Dot product with the gradient h of (1, 0), (0, 1), (-1, 0), (0, -1)
+      static inline int32_t grad(const int h, const int32_t x, const int32_t y) {
+        const int32_t v = (h & 1) ? y : x;
+        return (h & 2) ? -v : v;
+      }
+
+      inline int32_t grad(const int h, const int32_t x, const int32_t y, const int32_t z) const {
+        return lookup->grads3_x[h] * x + lookup->grads3_y[h] * y + lookup->grads3_z[h] * z;
+      }
+
+    public:
+      explicit basic_improved(uint64_t seed) : lookup(shared::intern<block>("fixed::improved", seed, 4, &build)) {}
+
+      /// 2D noise of Q14 coordinates, Q14 in [-one, one]
+      int32_t noise(int64_t X, int64_t Y) const {
+        const auto& hash = lookup->hash;
+        X += skew;
+        Y += skew;
+        const int x0 = (int) (X >> frac_bits), y0 = (int) (Y >> frac_bits);
+        const int32_t fx = (int32_t) (X & frac_mask), fy = (int32_t) (Y & frac_mask);
+        const int32_t d00 = grad(hash(x0, y0) & grads_mask, fx, fy);
+        const int32_t d10 = grad(hash(x0 + 1, y0) & grads_mask, fx - one, fy);
+        const int32_t d01 = grad(hash(x0, y0 + 1) & grads_mask, fx, fy - one);
+        const int32_t d11 = grad(hash(x0 + 1, y0 + 1) & grads_mask, fx - one, fy - one);
+        const int32_t wx = fade(fx);
+        const int32_t wy = fade(fy);
+        return clamp(lerp(wy, lerp(wx, d00, d10), lerp(wx, d01, d11)));
+      }
+
+      /// 3D noise of Q14 coordinates, Q14 in [-one, one]
+      int32_t noise(const int64_t X, const int64_t Y, const int64_t Z) const {
+        const auto& hash = lookup->hash;
+        const int x0 = (int) (X >> frac_bits), y0 = (int) (Y >> frac_bits), z0 = (int) (Z >> frac_bits);
+        const int32_t fx = (int32_t) (X & frac_mask), fy = (int32_t) (Y & frac_mask), fz = (int32_t) (Z & frac_mask);
+        int32_t d[8];
+        for (int c = 0; c < 8; c++) {
+          const int cx = c & 1, cy = (c >> 1) & 1, cz = c >> 2;
+          d[c] = grad(hash(x0 + cx, y0 + cy, z0 + cz) & grads3_mask, fx - cx * one, fy - cy * one, fz - cz * one);
+        }
+        const int32_t wx = fade(fx);
+        const int32_t wy = fade(fy);
+        const int32_t wz = fade(fz);
+        const int32_t ya = lerp(wy, lerp(wx, d[0], d[1]), lerp(wx, d[2], d[3]));
+        const int32_t yb = lerp(wy, lerp(wx, d[4], d[5]), lerp(wx, d[6], d[7]));
+        return clamp(lerp(wz, ya, yb));
+      }
+
+      T operator()(const T x, const T y) const override {
+        return to_real<T>(noise(from_real(x), from_real(y)));
+      }
+
+      T operator()(const T x, const T y, const T z) const override {
+        return to_real<T>(noise(from_real(x), from_real(y), from_real(z)));
+      }
+
+      /// Central differences over 1/64 of a cell, the noise is too coarse for the default step
+      derivative2 eval_with_gradient(const T x, const T y) const override {
+        const T h = T(1.0 / 64.0);
+        return {operator()(x, y), {(operator()(x + h, y) - operator()(x - h, y)) / (2 * h),
+                                   (operator()(x, y + h) - operator()(x, y - h)) / (2 * h)}};
+      }
+
+      derivative3 eval_with_gradient(const T x, const T y, const T z) const override {
+        const T h = T(1.0 / 64.0);
+        return {operator()(x, y, z), {(operator()(x + h, y, z) - operator()(x - h, y, z)) / (2 * h),
+                                      (operator()(x, y + h, z) - operator()(x, y - h, z)) / (2 * h),
+                                      (operator()(x, y, z + h) - operator()(x, y, z - h)) / (2 * h)}};
+      }
+
+      /// See basic_generator::name
+      const char* name() const override { return "fixed::improved"; }
+
+      /// Those of perlin::basic_improved, see basic_generator::mean_abs
+      T mean_abs(const int dims) const override { return dims == 2 ? T(0.17) : T(0.215); }
+
+      /// That of perlin::basic_improved, see basic_generator::lattice_gradient_bound
+      T max_gradient(const int dims) const override {
+        return dims == 2 ? base::lattice_gradient_bound(2, T(1.875), 1, 1) : base::lattice_gradient_bound(3, T(1.875), 2, 1);
+      }
+
+      /// Quantization of the values on both sides plus a Q14 step of the coordinates, measured rather than bounded so
+      /// classify_octaves is heuristic for this generator, see basic_generator::max_jump
+      T max_jump(const int dims) const override { return T(2 * quantization) + max_gradient(dims) * std::sqrt(T(dims)) / one; }
+
+      void fill(const grid2& grid, T* out) const override { fill_batched(*this, grid, out); }
+
+      void fill(const grid3& grid, T* out) const override { fill_batched(*this, grid, out); }
+
+      /// 8 points per step with AVX2, bit-identical to operator() since both do the same integer operations
+      void batch(const T* x, const T* y, T* out, const size_t count) const override {
+        size_t n = 0;
+#ifdef PN_SIMD_X86
+        if (pn::simd::detect() == pn::simd::level::avx2) { n = batch_avx2(x, y, out, count); }
+#endif
+        for (; n < count; n++) { out[n] = basic_improved::operator()(x[n], y[n]); }
+      }
+
+      void batch(const T* x, const T* y, const T* z, T* out, const size_t count) const override {
+        size_t n = 0;
+#ifdef PN_SIMD_X86
+        if (pn::simd::detect() == pn::simd::level::avx2) { n = batch_avx2(x, y, z, out, count); }
+#endif
+        for (; n < count; n++) { out[n] = basic_improved::operator()(x[n], y[n], z[n]); }
+      }
+
+#ifdef PN_SIMD_X86
+    private:
+      using V = pn::simd::avx2<T>;
+
+      /// split() of 8 coordinates
+      PN_TARGET("avx2") static inline void split_avx2(const T* v, __m256i& cell, __m256i& frac) {
+        alignas(32) int c[8], f[8];
+        for (int k = 0; k < 8; k += V::width) {
+          const typename V::type p = V::load(v + k);
+          const typename V::type fl = V::floor(p);
+          V::to_int(fl, c + k);
+          V::to_int(V::floor(V::mul(V::sub(p, fl), V::set1(T(one)))), f + k);
+        }
+        cell = _mm256_load_si256((const __m256i*) c);
+        frac = _mm256_load_si256((const __m256i*) f);
+        const __m256i carry = _mm256_srai_epi32(frac, frac_bits);
+        cell = _mm256_add_epi32(cell, carry);
+        frac = _mm256_and_si256(frac, _mm256_set1_epi32(frac_mask));
+      }
+
+      /// to_real() of 8 values
+      PN_TARGET("avx2") static inline void store_avx2(double* out, const __m256i v) {
+        const __m256d scale = _mm256_set1_pd(1.0 / one);
+        _mm256_storeu_pd(out, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), scale));
+        _mm256_storeu_pd(out + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), scale));
+      }
+
+      PN_TARGET("avx2") static inline void store_avx2(float* out, const __m256i v) {
+        _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(1.0f / one)));
+      }
+
+      PN_TARGET("avx2") static inline __m256i fade_avx2(const __m256i t) {
+        const __m256i t3 = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(t, t), frac_bits), t), frac_bits);
+        const __m256i a = _mm256_sub_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(t, _mm256_set1_epi32(6)), 2), _mm256_set1_epi32(15 * 4096));
+        const __m256i inner = _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(t, a), frac_bits), _mm256_set1_epi32(10 * 4096));
+        return _mm256_srai_epi32(_mm256_mullo_epi32(t3, inner), 12);
+      }
+
+      PN_TARGET("avx2") static inline __m256i lerp_avx2(const __m256i w, const __m256i a, const __m256i b) {
+        return _mm256_add_epi32(a, _mm256_srai_epi32(_mm256_mullo_epi32(w, _mm256_sub_epi32(b, a)), frac_bits));
+      }
+
+      PN_TARGET("avx2") static inline __m256i clamp_avx2(const __m256i v) {
+        return _mm256_max_epi32(_mm256_min_epi32(v, _mm256_set1_epi32(one)), _mm256_set1_epi32(-one));
+      }
+
+      /// grad() on each lane, picks x or y by bit 0 of the hash and negates by bit 1
+      PN_TARGET("avx2") static inline __m256i grad_avx2(const __m256i h, const __m256i x, const __m256i y) {
+        const __m256i use_y = _mm256_cmpeq_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), _mm256_set1_epi32(1));
+        const __m256i sign = _mm256_sub_epi32(_mm256_set1_epi32(1), _mm256_and_si256(h, _mm256_set1_epi32(2)));
+        return _mm256_sign_epi32(_mm256_blendv_epi8(x, y, use_y), sign);
+      }
+
+      PN_TARGET("avx2") inline __m256i grad_avx2(const __m256i h, const __m256i x, const __m256i y, const __m256i z) const {
+        const __m256i gx = _mm256_i32gather_epi32(lookup->grads3_x.data(), h, 4);
+        const __m256i gy = _mm256_i32gather_epi32(lookup->grads3_y.data(), h, 4);
+        const __m256i gz = _mm256_i32gather_epi32(lookup->grads3_z.data(), h, 4);
+        return _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(gx, x), _mm256_mullo_epi32(gy, y)), _mm256_mullo_epi32(gz, z));
+      }
+
+      /// 2D noise 8 points at a time, returns the number of points processed
+      PN_TARGET("avx2") size_t batch_avx2(const T* x, const T* y, T* out, const size_t count) const {
+        const auto& hash = lookup->hash;
+        const __m256i unit = _mm256_set1_epi32(1);
+        const __m256i full = _mm256_set1_epi32(one);
+        const __m256i mask = _mm256_set1_epi32(grads_mask);
+        size_t n = 0;
+        for (; n + 8 <= count; n += 8) {
+          __m256i x0, fx, y0, fy;
+          split_avx2(x + n, x0, fx);
+          split_avx2(y + n, y0, fy);
+          fx = _mm256_add_epi32(fx, _mm256_set1_epi32(skew));
+          fy = _mm256_add_epi32(fy, _mm256_set1_epi32(skew));
+          x0 = _mm256_add_epi32(x0, _mm256_srai_epi32(fx, frac_bits));
+          y0 = _mm256_add_epi32(y0, _mm256_srai_epi32(fy, frac_bits));
+          fx = _mm256_and_si256(fx, _mm256_set1_epi32(frac_mask));
+          fy = _mm256_and_si256(fy, _mm256_set1_epi32(frac_mask));
+          const __m256i x1 = _mm256_add_epi32(x0, unit), y1 = _mm256_add_epi32(y0, unit);
+          const __m256i gx = _mm256_sub_epi32(fx, full), gy = _mm256_sub_epi32(fy, full);
+          const __m256i d00 = grad_avx2(_mm256_and_si256(hash(x0, y0), mask), fx, fy);
+          const __m256i d10 = grad_avx2(_mm256_and_si256(hash(x1, y0), mask), gx, fy);
+          const __m256i d01 = grad_avx2(_mm256_and_si256(hash(x0, y1), mask), fx, gy);
+          const __m256i d11 = grad_avx2(_mm256_and_si256(hash(x1, y1), mask), gx, gy);
+          const __m256i wx = fade_avx2(fx);
+          const __m256i wy = fade_avx2(fy);
+          store_avx2(out + n, clamp_avx2(lerp_avx2(wy, lerp_avx2(wx, d00, d10), lerp_avx2(wx, d01, d11))));
+        }
+        return n;
+      }
+
+      /// 3D noise 8 points at a time, returns the number of points processed
+      PN_TARGET("avx2") size_t batch_avx2(const T* x, const T* y, const T* z, T* out, const size_t count) const {
+        const auto& hash = lookup->hash;
+        const __m256i unit = _mm256_set1_epi32(1);
+        const __m256i full = _mm256_set1_epi32(one);
+        const __m256i mask = _mm256_set1_epi32(grads3_mask);
+        size_t n = 0;
+        for (; n + 8 <= count; n += 8) {
+          __m256i c0[3], f0[3];
+          split_avx2(x + n, c0[0], f0[0]);
+          split_avx2(y + n, c0[1], f0[1]);
+          split_avx2(z + n, c0[2], f0[2]);
+          const __m256i c1[3] = {_mm256_add_epi32(c0[0], unit), _mm256_add_epi32(c0[1], unit), _mm256_add_epi32(c0[2], unit)};
+          const __m256i f1[3] = {_mm256_sub_epi32(f0[0], full), _mm256_sub_epi32(f0[1], full), _mm256_sub_epi32(f0[2], full)};
+          __m256i d[8];
+          for (int c = 0; c < 8; c++) {
+            const int cx = c & 1, cy = (c >> 1) & 1, cz = c >> 2;
+            const __m256i h = _mm256_and_si256(hash(cx ? c1[0] : c0[0], cy ? c1[1] : c0[1], cz ? c1[2] : c0[2]), mask);
+            d[c] = grad_avx2(h, cx ? f1[0] : f0[0], cy ? f1[1] : f0[1], cz ? f1[2] : f0[2]);
+          }
+          const __m256i wx = fade_avx2(f0[0]);
+          const __m256i wy = fade_avx2(f0[1]);
+          const __m256i wz = fade_avx2(f0[2]);
+          const __m256i ya = lerp_avx2(wy, lerp_avx2(wx, d[0], d[1]), lerp_avx2(wx, d[2], d[3]));
+          const __m256i yb = lerp_avx2(wy, lerp_avx2(wx, d[4], d[5]), lerp_avx2(wx, d[6], d[7]));
+          store_avx2(out + n, clamp_avx2(lerp_avx2(wz, ya, yb)));
+        }
+        return n;
+      }
+#endif
+    };
+
+    template<int num_grads = 256, typename Hash = pn::hash::table<num_grads>>
+    using improved = basic_improved<double, num_grads, Hash>;
+    template<int num_grads = 256, typename Hash = pn::hash::table<num_grads>>
+    using improvedf = basic_improved<float, num_grads, Hash>;
+
+    /**
+     * Simplex noise in fixed point, the skew, gradients and permutation of simplex::basic_tables. The skew factors are
+     * Q30 and the vertex offsets and falloff Q24, the lattice cell and the offset inside it are skewed separately so
+     * that the 64-bit products do not overflow for cells up to 2^31.
+     */
+    template<typename T, int num_grads = 256>
+    class basic_tables : public pn::basic_generator<T> {
+    public:
+      using base = pn::basic_generator<T>;
+      using typename base::vec2;
+      using typename base::vec3;
+      using typename base::derivative2;
+      using typename base::derivative3;
+
+    private:
+      static_assert(num_grads > 0 && num_grads <= 256 && (num_grads & (num_grads - 1)) == 0,
+                    "num_grads must be a power of two that fits the uint8_t permutation table");
+
+      /// Permutation and gradients of a seed, interned and shared by every generator built with it, see pn::shared
+      struct block {
+        /// Permutation table, stored twice so that chained lookups never wrap
+        std::array<uint8_t, 2 * num_grads> perms;
+
+        /// Q14 gradients, quantized from the normalized gradients of simplex::basic_tables
+        std::array<int32_t, num_grads> grads2_x, grads2_y;
+        std::array<int32_t, num_grads> grads3_x, grads3_y, grads3_z;
+      };
+
+      shared::handle<block> lookup;
+
+      static inline int wrap(const int i) { return i & (num_grads - 1); }
+
+      /// Jumps at the simplex faces, those of simplex::basic_tables, see basic_generator::surflet_jump_bound
+      static T face_jump(const int dims) {
+        return dims == 2 ? base::surflet_jump_bound(8, T(0.6), std::sqrt(T(0.5)), 3)
+                         : base::surflet_jump_bound(40, T(0.6), std::sqrt(T(0.5)), 6);
+      }
+
+      /// Fractional bits of the vertex offsets and the falloff, finer than the coordinates since the 3D sum is scaled by 40
+      static const int inner_bits = 24;
+      static const int64_t inner_one = int64_t(1) << inner_bits;
+
+      /// Squared radius 0.6 of the surflets, Q24
+      static const int64_t radius = 10066330;
+
+      /// floor(v * f) in Q14 of a Q14 v and a Q30 factor f, cell and fraction multiplied separately
+      static inline int64_t scale(const int64_t v, const int64_t f) {
+        return (((v >> frac_bits) * f) >> 16) + (((v & frac_mask) * f) >> 30);
+      }
+
+      /// Draws the gradients and the permutation exactly like simplex::basic_tables
+      static void build(block& t, const uint64_t seed) {
+        std::mt19937 engine(seed);
+        std::uniform_real_distribution<T> distr(-1.0, 1.0);
+        for (int i = 0; i < num_grads; i++) {
+          const T x = distr(engine);
+          const T y = distr(engine);
+          const T z = distr(engine);
+          const vec2 g2 = pn::normalize(vec2{x, y});
+          const vec3 g3 = pn::normalize(vec3{x, y, z});
+          t.grads2_x[i] = (int32_t) std::lround(g2.x * one);
+          t.grads2_y[i] = (int32_t) std::lround(g2.y * one);
+          t.grads3_x[i] = (int32_t) std::lround(g3.x * one);
+          t.grads3_y[i] = (int32_t) std::lround(g3.y * one);
+          t.grads3_z[i] = (int32_t) std::lround(g3.z * one);
+        }
+        std::iota(t.perms.begin(), t.perms.begin() + num_grads, 0);
+        std::shuffle(t.perms.begin(), t.perms.begin() + num_grads, engine);
+        std::copy(t.perms.begin(), t.perms.begin() + num_grads, t.perms.begin() + num_grads);
+      }
+
+      /// Q24 offset of a Q14 coordinate from lattice cell i, t the Q24 unskew of the cell
+      static inline int64_t offset(const int64_t v, const int i, const int64_t t) {
+        return v * (int64_t(1) << (inner_bits - frac_bits)) - i * inner_one + t;
+      }
+
+      /// Surflet t^4 (g . v) of a vertex at Q24 offset v, Q48, 0 outside the radius
+      inline int64_t surflet(const int g, const int64_t x, const int64_t y) const {
+        const int64_t t = radius - ((x * x + y * y) >> inner_bits);
+        if (t <= 0) { return 0; }
+        const int64_t t2 = (t * t) >> inner_bits;
+        return ((t2 * t2) >> inner_bits) * ((lookup->grads2_x[g] * x + lookup->grads2_y[g] * y) >> frac_bits);
+      }
+
+      inline int64_t surflet(const int g, const int64_t x, const int64_t y, const int64_t z) const {
+        const int64_t t = radius - ((x * x + y * y + z * z) >> inner_bits);
+        if (t <= 0) { return 0; }
+        const int64_t t2 = (t * t) >> inner_bits;
+        return ((t2 * t2) >> inner_bits) * ((lookup->grads3_x[g] * x + lookup->grads3_y[g] * y + lookup->grads3_z[g] * z) >> frac_bits);
+      }
+
+      /// Q14 value of a Q48 surflet sum times scale, clamped to [-one, one]
+      static inline int32_t result(const int64_t scale, const int64_t sum) {
+        const int64_t v = (scale * sum) >> (2 * inner_bits - frac_bits);
+        return (int32_t) std::max<int64_t>(std::min<int64_t>(v, one), -one);
+      }
+
+    public:
+      explicit basic_tables(uint64_t seed) : lookup(shared::intern<block>("fixed::tables", seed, num_grads, &build)) {}
+
+      /// 2D noise of Q14 coordinates, Q14 in [-one, one]
+      int32_t noise(const int64_t X, const int64_t Y) const {
+        const auto& perms = lookup->perms;
+        const int64_t F = 393016785; // (sqrt(3) - 1) / 2 in Q30
+        const int64_t G = 226908346; // (3 - sqrt(3)) / 6 in Q30
+        const int64_t G24 = G >> (30 - inner_bits);
+        const int64_t s = scale(X + Y, F);
+        const int i = (int) ((X + s) >> frac_bits);
+        const int j = (int) ((Y + s) >> frac_bits);
+        const int64_t t = (((int64_t) i + j) * G) >> (30 - inner_bits);
+        const int64_t xa = offset(X, i, t);
+        const int64_t ya = offset(Y, j, t);
+        const int x_step = xa > ya ? 1 : 0;
+        const int y_step = 1 - x_step;
+        const int ii = wrap(i);
+        const int jj = wrap(j);
+        int64_t sum = surflet(perms[ii + perms[jj]], xa, ya);
+        sum += surflet(perms[ii + x_step + perms[jj + y_step]], xa - x_step * inner_one + G24, ya - y_step * inner_one + G24);
+        sum += surflet(perms[ii + 1 + perms[jj + 1]], xa - inner_one + 2 * G24, ya - inner_one + 2 * G24);
+        return result(8, sum);
+      }
+
+      /// 3D noise of Q14 coordinates, Q14 in [-one, one]
+      int32_t noise(const int64_t X, const int64_t Y, const int64_t Z) const {
+        const auto& perms = lookup->perms;
+        const int64_t F = 357913941; // 1 / 3 in Q30
+        const int64_t G = 178956971; // 1 / 6 in Q30
+        const int64_t G24 = G >> (30 - inner_bits);
+        const int64_t s = scale(X + Y + Z, F);
+        const int i = (int) ((X + s) >> frac_bits);
+        const int j = (int) ((Y + s) >> frac_bits);
+        const int k = (int) ((Z + s) >> frac_bits);
+        const int64_t t = (((int64_t) i + j + k) * G) >> (30 - inner_bits);
+        const int64_t xa = offset(X, i, t);
+        const int64_t ya = offset(Y, j, t);
+        const int64_t za = offset(Z, k, t);
+        const int xy = xa >= ya;
+        const int xz = xa >= za;
+        const int yz = ya >= za;
+        const int i1 = xy & xz;
+        const int j1 = (xy ^ 1) & yz;
+        const int k1 = (xz | yz) ^ 1;
+        const int i2 = xy | xz;
+        const int j2 = (xy ^ 1) | yz;
+        const int k2 = (xz & yz) ^ 1;
+        const int ii = wrap(i);
+        const int jj = wrap(j);
+        const int kk = wrap(k);
+        int64_t sum = surflet(perms[ii + perms[jj + perms[kk]]], xa, ya, za);
+        sum += surflet(perms[ii + i1 + perms[jj + j1 + perms[kk + k1]]],
+                       xa - i1 * inner_one + G24, ya - j1 * inner_one + G24, za - k1 * inner_one + G24);
+        sum += surflet(perms[ii + i2 + perms[jj + j2 + perms[kk + k2]]],
+                       xa - i2 * inner_one + 2 * G24, ya - j2 * inner_one + 2 * G24, za - k2 * inner_one + 2 * G24);
+        sum += surflet(perms[ii + 1 + perms[jj + 1 + perms[kk + 1]]],
+                       xa - inner_one + 3 * G24, ya - inner_one + 3 * G24, za - inner_one + 3 * G24);
+        return result(40, sum);
+      }
+
+      T operator()(const T x, const T y) const override {
+        return to_real<T>(noise(from_real(x), from_real(y)));
+      }
+
+      T operator()(const T x, const T y, const T z) const override {
+        return to_real<T>(noise(from_real(x), from_real(y), from_real(z)));
+      }
+
+      /// Central differences over 1/64 of a cell, the noise is too coarse for the default step
+      derivative2 eval_with_gradient(const T x, const T y) const override {
+        const T h = T(1.0 / 64.0);
+        return {operator()(x, y), {(operator()(x + h, y) - operator()(x - h, y)) / (2 * h),
+                                   (operator()(x, y + h) - operator()(x, y - h)) / (2 * h)}};
+      }
+
+      derivative3 eval_with_gradient(const T x, const T y, const T z) const override {
+        const T h = T(1.0 / 64.0);
+        return {operator()(x, y, z), {(operator()(x + h, y, z) - operator()(x - h, y, z)) / (2 * h),
+                                      (operator()(x, y + h, z) - operator()(x, y - h, z)) / (2 * h),
+                                      (operator()(x, y, z + h) - operator()(x, y, z - h)) / (2 * h)}};
+      }
+
+      /// See basic_generator::name
+      const char* name() const override { return "fixed::tables"; }
+
+      /// Those of simplex::basic_tables, see basic_generator::mean_abs
+      T mean_abs(const int dims) const override { return dims == 2 ? T(0.093) : T(0.312); }
+
+      /// That of simplex::basic_tables, see basic_generator::surflet_gradient_bound
+      T max_gradient(const int dims) const override {
+        return dims == 2 ? base::surflet_gradient_bound(3, 8, T(0.6)) + face_jump(2) / std::sqrt(T(0.5))
+                         : base::surflet_gradient_bound(4, 40, T(0.6)) + face_jump(3) / std::sqrt(T(0.5));
+      }
+
+      /// The simplex faces of simplex::basic_tables plus quantization as for basic_improved, measured rather than
+      /// bounded so classify_octaves is heuristic for this generator, see basic_generator::max_jump
+      T max_jump(const int dims) const override {
+        return face_jump(dims) + T(2 * quantization) + max_gradient(dims) * std::sqrt(T(dims)) / one;
+      }
+    };
+
+    template<int num_grads = 256>
+    using tables = basic_tables<double, num_grads>;
+    template<int num_grads = 256>
+    using tablesf = basic_tables<float, num_grads>;
+  }
+}
+
+#endif // FIXED_H
@@ -0,0 +1,517 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <vector>
+#include <map>
+#include <initializer_list>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "noise.hpp"
+
+namespace pn {
+  /// Per-octave term of a fractal node, same sums as generator::fbm, turbulence and turbulence_ridged
+  enum class fractal_mode { fbm, turbulence, ridged };
+
+  template<typename T>
+  class basic_graph;
+
+  /**
+   * Flat program compiled from a basic_graph.
+   *
+   * Points are evaluated in blocks of block_size: every instruction runs over a whole block before the next one, so
+   * each noise source costs one virtual batch() call per block and the registers (one block of T each, in a buffer
+   * kept per thread) are the only intermediate storage. Registers are reused as soon as their value is dead. The
+   * generators of the graph must outlive the program; evaluation does not modify the program and may run concurrently.
+   */
+  template<typename T>
+  class basic_program {
+  public:
+    using grid2 = pn::basic_grid2<T>;
+    using grid3 = pn::basic_grid3<T>;
+
+    /// Number of points evaluated per instruction
+    static const size_t block_size = 128;
+
+    /// 2 or 3, the dimension of the noise sources
+    int dims() const { return dimensions; }
+
+    /// Number of instructions executed per block
+    size_t size() const { return code.size(); }
+
+    /// Number of block registers, inputs and constants included
+    size_t num_registers() const { return register_count; }
+
+    /// Evaluates out[n] = program(x[n], y[n]), a 3D program evaluates at z = 0
+    void evaluate(const T* x, const T* y, T* out, const size_t count) const { run(x, y, nullptr, out, count); }
+
+    /// Evaluates out[n] = program(x[n], y[n], z[n]), a 2D program ignores z
+    void evaluate(const T* x, const T* y, const T* z, T* out, const size_t count) const { run(x, y, z, out, count); }
+
+    T operator()(const T x, const T y) const {
+      T out;
+      run(&x, &y, nullptr, &out, 1);
+      return out;
+    }
+
+    T operator()(const T x, const T y, const T z) const {
+      T out;
+      run(&x, &y, &z, &out, 1);
+      return out;
+    }
+
+    /// Fills a 2D lattice, see basic_grid2
+    void fill(const grid2& grid, T* out) const {
+      T xs[block_size];
+      T ys[block_size];
+      for (size_t j = 0; j < grid.ny; j++) {
+        T* row = out + j * grid.stride;
+        for (size_t i0 = 0; i0 < grid.nx; i0 += block_size) {
+          const size_t n = std::min(block_size, grid.nx - i0);
+          for (size_t i = 0; i < n; i++) {
+            xs[i] = grid.x0 + (i0 + i) * grid.dx;
+            ys[i] = grid.y0 + j * grid.dy;
+          }
+          run(xs, ys, nullptr, row + i0, n);
+        }
+      }
+    }
+
+    /// Fills a 3D lattice, see basic_grid3
+    void fill(const grid3& grid, T* out) const {
+      T xs[block_size];
+      T ys[block_size];
+      T zs[block_size];
+      for (size_t k = 0; k < grid.nz; k++) {
+        for (size_t j = 0; j < grid.ny; j++) {
+          T* row = out + k * grid.slice_stride + j * grid.stride;
+          for (size_t i0 = 0; i0 < grid.nx; i0 += block_size) {
+            const size_t n = std::min(block_size, grid.nx - i0);
+            for (size_t i = 0; i < n; i++) {
+              xs[i] = grid.x0 + (i0 + i) * grid.dx;
+              ys[i] = grid.y0 + j * grid.dy;
+              zs[i] = grid.z0 + k * grid.dz;
+            }
+            run(xs, ys, zs, row + i0, n);
+          }
+        }
+      }
+    }
+
+  private:
+    friend class basic_graph<T>;
+
+    enum class opcode : uint8_t {
+      input,      // Coordinate a (0 = x, 1 = y, 2 = z), never emitted
+      constant,   // p0, never emitted
+      noise2,     // gen(a, b)
+      noise3,     // gen(a, b, c)
+      add,        // a + b
+      mul,        // a * b
+      scale_bias, // a * p0 + p1
+      div,        // a / p0
+      axpy,       // a + b * p0
+      abs,        // |a|
+      clamp,      // a clamped to [p0, p1]
+      select      // a where c < p0 - p1, b where c > p0 + p1, smoothstep blend in between
+    };
+
+    struct instruction {
+      opcode op;
+      uint32_t dst, a, b, c;
+      T p0, p1;
+      const pn::basic_generator<T>* gen;
+    };
+
+    int dimensions = 3;
+    std::vector<instruction> code;
+    std::vector<std::pair<uint32_t, T>> constants; // Registers holding a constant and their value
+    uint32_t result = 0;
+    size_t register_count = 3;
+
+    static inline T select(const T control, const T a, const T b, const T threshold, const T falloff) {
+      if (control <= threshold - falloff) { return a; }
+      if (control >= threshold + falloff) { return b; }
+      T t = (control - (threshold - falloff)) / (2 * falloff);
+      t = t * t * (3 - 2 * t);
+      return (1 - t) * a + t * b;
+    }
+
+    static inline T clamp(const T in, const T lo, const T hi) { return std::max(lo, std::min(hi, in)); }
+
+    /// Value of an arithmetic instruction on scalars, also used to fold constants at compile time
+    static inline T apply(const opcode op, const T a, const T b, const T c, const T p0, const T p1) {
+      switch (op) {
+        case opcode::add: return a + b;
+        case opcode::mul: return a * b;
+        case opcode::scale_bias: return a * p0 + p1;
+        case opcode::div: return a / p0;
+        case opcode::axpy: return a + b * p0;
+        case opcode::abs: return std::abs(a);
+        case opcode::clamp: return clamp(a, p0, p1);
+        case opcode::select: return select(c, a, b, p0, p1);
+        default: return 0;
+      }
+    }
+
+    /// Registers of the calling thread, grown to the largest program it ran so that run() does not allocate
+    static T* registers(const size_t size) {
+      thread_local std::vector<T> buffer;
+      if (buffer.size() < size) { buffer.resize(size); }
+      return buffer.data();
+    }
+
+    void run(const T* x, const T* y, const T* z, T* out, const size_t count) const {
+      T* registers = basic_program::registers(register_count * block_size);
+      auto reg = [&](const uint32_t r) { return registers + r * block_size; };
+      const size_t width = std::min(block_size, count);
+      for (const auto& constant : constants) {
+        std::fill(reg(constant.first), reg(constant.first) + width, constant.second);
+      }
+      for (size_t n0 = 0; n0 < count; n0 += block_size) {
+        const size_t n = std::min(block_size, count - n0);
+        std::copy(x + n0, x + n0 + n, reg(0));
+        std::copy(y + n0, y + n0 + n, reg(1));
+        if (z != nullptr) {
+          std::copy(z + n0, z + n0 + n, reg(2));
+        } else {
+          std::fill(reg(2), reg(2) + n, T(0));
+        }
+        for (const instruction& in : code) {
+          T* dst = reg(in.dst);
+          const T* a = reg(in.a);
+          const T* b = reg(in.b);
+          const T* c = reg(in.c);
+          switch (in.op) {
+            case opcode::noise2: in.gen->batch(a, b, dst, n); break;
+            case opcode::noise3: in.gen->batch(a, b, c, dst, n); break;
+            case opcode::add: for (size_t i = 0; i < n; i++) { dst[i] = a[i] + b[i]; } break;
+            case opcode::mul: for (size_t i = 0; i < n; i++) { dst[i] = a[i] * b[i]; } break;
+            case opcode::scale_bias: for (size_t i = 0; i < n; i++) { dst[i] = a[i] * in.p0 + in.p1; } break;
+            case opcode::div: for (size_t i = 0; i < n; i++) { dst[i] = a[i] / in.p0; } break;
+            case opcode::axpy: for (size_t i = 0; i < n; i++) { dst[i] = a[i] + b[i] * in.p0; } break;
+            case opcode::abs: for (size_t i = 0; i < n; i++) { dst[i] = std::abs(a[i]); } break;
+            case opcode::clamp:
+              for (size_t i = 0; i < n; i++) { dst[i] = clamp(a[i], in.p0, in.p1); }
+              break;
+            case opcode::select:
+              for (size_t i = 0; i < n; i++) { dst[i] = select(c[i], a[i], b[i], in.p0, in.p1); }
+              break;
+            default: break;
+          }
+        }
+        std::copy(reg(result), reg(result) + n, out + n0);
+      }
+    }
+  };
+
+  // Definition of the static member bound to a reference (std::min), required before C++17
+  template<typename T>
+  const size_t basic_program<T>::block_size;
+
+  /**
+   * libnoise style module graph: sources are generators, operators combine the nodes below them.
+   *
+   * Nodes are created bottom-up, so the graph is a DAG by construction. compile() flattens the graph under one node
+   * into a basic_program: warps and fractal octaves are expanded into coordinate arithmetic, every value is numbered
+   * by its operation and operands so that equal subexpressions (the same source at the same coordinates, the same
+   * octave scaling...) are computed once, operations on constants are folded and registers are allocated by liveness.
+   * Building the graph is cheap, compile once and evaluate the program.
+   */
+  template<typename T>
+  class basic_graph {
+  public:
+    /// Handle of a node of the graph
+    struct node {
+      uint32_t id;
+    };
+
+    /// Constant value everywhere
+    node constant(const T value) { return push(kind::constant, {}, value); }
+
+    /// Raw noise of gen at the coordinates, 2D or 3D depending on the program. gen must outlive the compiled programs
+    node source(const pn::basic_generator<T>& gen) { return push(kind::source, {}, 0, 0, &gen); }
+
+    /// a + b
+    node add(const node a, const node b) { return push(kind::add, {a.id, b.id}); }
+
+    /// a * b
+    node multiply(const node a, const node b) { return push(kind::multiply, {a.id, b.id}); }
+
+    /**
+     * a where control is below threshold, b above it. With a falloff the two are blended with a smoothstep over
+     * [threshold - falloff, threshold + falloff].
+     */
+    node select(const node control, const node a, const node b, const T threshold, const T falloff = 0) {
+      return push(kind::select, {a.id, b.id, control.id}, threshold, std::max(falloff, T(0)));
+    }
+
+    /// a clamped to [lo, hi]
+    node clamp(const node a, const T lo, const T hi) { return push(kind::clamp, {a.id}, lo, hi); }
+
+    /// a * scale + bias
+    node scale_bias(const node a, const T scale, const T bias) { return push(kind::scale_bias, {a.id}, scale, bias); }
+
+    /// a at (x + strength * dx, y + strength * dy, z), the displacements are evaluated at (x, y, z)
+    node warp(const node a, const node dx, const node dy, const T strength = 1) {
+      return push(kind::warp, {a.id, dx.id, dy.id}, strength);
+    }
+
+    /// a at (x + strength * dx, y + strength * dy, z + strength * dz), 2D programs ignore dz
+    node warp(const node a, const node dx, const node dy, const node dz, const T strength = 1) {
+      return push(kind::warp, {a.id, dx.id, dy.id, dz.id}, strength);
+    }
+
+    /// Fractal sum of a over the octaves zoom_factor, zoom_factor / 2, ... >= 1, like generator::fbm on a source
+    node fractal(const node a, const fractal_mode mode, const T zoom_factor) {
+      return push(kind::fractal, {a.id}, zoom_factor, (T) (int) mode);
+    }
+
+    /// Compiles the graph under output into a program whose sources are evaluated in dims (2 or 3) dimensions
+    basic_program<T> compile(const node output, const int dims = 3) const {
+      compiler c{*this, program{}, {}, {}, {}};
+      c.result.dimensions = dims == 2 ? 2 : 3;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        c.emit(value{opcode::input, axis, no_value, no_value, 0, 0, nullptr});
+      }
+      c.allocate(c.compile(output.id, {{0, 1, c.result.dimensions == 2 ? no_value : 2}}));
+      return c.result;
+    }
+
+  private:
+    using program = basic_program<T>;
+    using opcode = typename program::opcode;
+
+    enum class kind : uint8_t { constant, source, add, multiply, select, clamp, scale_bias, warp, fractal };
+
+    static const uint32_t no_value = UINT32_MAX;
+
+    struct node_def {
+      kind type;
+      std::array<uint32_t, 4> inputs;
+      uint32_t num_inputs;
+      T p0, p1;
+      const pn::basic_generator<T>* gen;
+    };
+
+    std::vector<node_def> nodes;
+
+    node push(const kind type, std::initializer_list<uint32_t> inputs, const T p0 = 0, const T p1 = 0,
+              const pn::basic_generator<T>* gen = nullptr) {
+      node_def def{type, {{no_value, no_value, no_value, no_value}}, 0, p0, p1, gen};
+      for (const uint32_t input : inputs) { def.inputs[def.num_inputs++] = input; }
+      nodes.push_back(def);
+      return node{(uint32_t) (nodes.size() - 1)};
+    }
+
+    /// One SSA value of the program being compiled
+    struct value {
+      opcode op;
+      uint32_t a, b, c;
+      T p0, p1;
+      const pn::basic_generator<T>* gen;
+    };
+
+    /// Orders values by operation and operands, T compared bitwise so that e.g. 0 and -0 stay distinct
+    struct value_less {
+      bool operator()(const value& l, const value& r) const {
+        if (l.op != r.op) { return l.op < r.op; }
+        if (l.a != r.a) { return l.a < r.a; }
+        if (l.b != r.b) { return l.b < r.b; }
+        if (l.c != r.c) { return l.c < r.c; }
+        if (l.gen != r.gen) { return std::less<const void*>()(l.gen, r.gen); }
+        const int p0 = std::memcmp(&l.p0, &r.p0, sizeof(T));
+        if (p0 != 0) { return p0 < 0; }
+        return std::memcmp(&l.p1, &r.p1, sizeof(T)) < 0;
+      }
+    };
+
+    using coords = std::array<uint32_t, 3>;
+
+    struct compiler {
+      const basic_graph& graph;
+      program result;
+      std::vector<value> values;
+      std::map<value, uint32_t, value_less> numbering;
+      std::map<std::array<uint32_t, 4>, uint32_t> memo; // (node, coordinates) -> value
+
+      /// Value of an operation, reusing an equal one or folding it if every operand is constant
+      uint32_t emit(value v) {
+        if ((v.op == opcode::add || v.op == opcode::mul) && v.b < v.a) { std::swap(v.a, v.b); }
+        const bool foldable = v.op != opcode::noise2 && v.op != opcode::noise3 && v.op != opcode::input &&
+          v.op != opcode::constant && is_constant(v.a) && is_constant(v.b) && is_constant(v.c);
+        if (foldable) {
+          return constant(program::apply(v.op, constant_of(v.a), constant_of(v.b), constant_of(v.c), v.p0, v.p1));
+        }
+        const auto it = numbering.find(v);
+        if (it != numbering.end()) { return it->second; }
+        values.push_back(v);
+        const uint32_t id = (uint32_t) (values.size() - 1);
+        numbering.emplace(v, id);
+        return id;
+      }
+
+      uint32_t constant(const T c) { return emit(value{opcode::constant, no_value, no_value, no_value, c, 0, nullptr}); }
+
+      bool is_constant(const uint32_t v) const { return v == no_value || values[v].op == opcode::constant; }
+
+      T constant_of(const uint32_t v) const { return v == no_value ? T(0) : values[v].p0; }
+
+      uint32_t unary(const opcode op, const uint32_t a, const T p0 = 0, const T p1 = 0) {
+        return emit(value{op, a, no_value, no_value, p0, p1, nullptr});
+      }
+
+      uint32_t binary(const opcode op, const uint32_t a, const uint32_t b, const T p0 = 0) {
+        return emit(value{op, a, b, no_value, p0, 0, nullptr});
+      }
+
+      uint32_t compile(const uint32_t id, const coords& at) {
+        const std::array<uint32_t, 4> key{{id, at[0], at[1], at[2]}};
+        const auto it = memo.find(key);
+        if (it != memo.end()) { return it->second; }
+        const node_def& n = graph.nodes[id];
+        const auto input = [&](const uint32_t i) { return compile(n.inputs[i], at); };
+        uint32_t v = no_value;
+        switch (n.type) {
+          case kind::constant:
+            v = constant(n.p0);
+            break;
+          case kind::source:
+            if (at[2] == no_value) {
+              v = emit(value{opcode::noise2, at[0], at[1], no_value, 0, 0, n.gen});
+            } else {
+              v = emit(value{opcode::noise3, at[0], at[1], at[2], 0, 0, n.gen});
+            }
+            break;
+          case kind::add:
+            v = binary(opcode::add, input(0), input(1));
+            break;
+          case kind::multiply:
+            v = binary(opcode::mul, input(0), input(1));
+            break;
+          case kind::select: {
+            const uint32_t control = input(2);
+            v = emit(value{opcode::select, input(0), input(1), control, n.p0, n.p1, nullptr});
+            break;
+          }
+          case kind::clamp:
+            v = unary(opcode::clamp, input(0), n.p0, n.p1);
+            break;
+          case kind::scale_bias:
+            v = unary(opcode::scale_bias, input(0), n.p0, n.p1);
+            break;
+          case kind::warp: {
+            coords warped = at;
+            for (uint32_t axis = 0; axis < 3; axis++) {
+              if (at[axis] == no_value || n.inputs[1 + axis] == no_value) { continue; }
+              warped[axis] = binary(opcode::axpy, at[axis], input(1 + axis), n.p0);
+            }
+            v = compile(n.inputs[0], warped);
+            break;
+          }
+          case kind::fractal:
+            v = fractal(n, at);
+            break;
+        }
+        memo.emplace(key, v);
+        return v;
+      }
+
+      /// Unrolls the octaves with the operation order of the generator helpers, so the sums are the same
+      uint32_t fractal(const node_def& n, const coords& at) {
+        const fractal_mode mode = (fractal_mode) (int) n.p1;
+        const T zoom_factor = n.p0;
+        uint32_t sum = no_value;
+        for (T zoom = zoom_factor; zoom >= 1.0; zoom /= 2) {
+          coords scaled = at;
+          for (uint32_t axis = 0; axis < 3; axis++) {
+            if (at[axis] != no_value) { scaled[axis] = unary(opcode::div, at[axis], zoom); }
+          }
+          uint32_t octave = compile(n.inputs[0], scaled);
+          if (mode == fractal_mode::turbulence) {
+            octave = unary(opcode::abs, octave);
+          } else if (mode == fractal_mode::ridged) {
+            // 1 - |noise * zoom|, added as a whole below
+            octave = unary(opcode::scale_bias, unary(opcode::abs, octave), -zoom, 1);
+          }
+          if (mode == fractal_mode::ridged) {
+            sum = sum == no_value ? octave : binary(opcode::add, sum, octave);
+          } else {
+            sum = sum == no_value ? unary(opcode::scale_bias, octave, zoom, 0) : binary(opcode::axpy, sum, octave, zoom);
+          }
+        }
+        return sum == no_value ? constant(0) : unary(opcode::div, sum, zoom_factor);
+      }
+
+      /// Emits the instructions of the values the result depends on, reusing registers once a value is dead
+      void allocate(const uint32_t output) {
+        // Keep only the values reachable from the result, folding may have left others behind
+        std::vector<bool> live(values.size(), false);
+        live[output] = true;
+        for (size_t v = values.size(); v-- > 0;) {
+          if (!live[v]) { continue; }
+          for (const uint32_t operand : {values[v].a, values[v].b, values[v].c}) {
+            if (operand != no_value && values[v].op != opcode::input) { live[operand] = true; }
+          }
+        }
+        std::vector<size_t> last_use(values.size(), 0);
+        for (size_t v = 0; v < values.size(); v++) {
+          if (!live[v] || values[v].op == opcode::input) { continue; }
+          for (const uint32_t operand : {values[v].a, values[v].b, values[v].c}) {
+            if (operand != no_value) { last_use[operand] = v; }
+          }
+        }
+        last_use[output] = values.size();
+
+        // Inputs own registers 0-2 and constants are written once per call, neither is ever reused
+        std::vector<uint32_t> reg(values.size(), no_value);
+        uint32_t count = 3;
+        for (uint32_t v = 0; v < values.size(); v++) {
+          if (values[v].op == opcode::input) {
+            reg[v] = values[v].a;
+          } else if (values[v].op == opcode::constant && live[v]) {
+            reg[v] = count++;
+            result.constants.emplace_back(reg[v], values[v].p0);
+          }
+        }
+        std::vector<uint32_t> free;
+        for (uint32_t v = 0; v < values.size(); v++) {
+          const value& val = values[v];
+          if (!live[v] || val.op == opcode::input || val.op == opcode::constant) { continue; }
+          if (free.empty()) {
+            reg[v] = count++;
+          } else {
+            reg[v] = free.back();
+            free.pop_back();
+          }
+          const auto reg_of = [&](const uint32_t operand) { return operand == no_value ? 0 : reg[operand]; };
+          result.code.push_back({val.op, reg[v], reg_of(val.a), reg_of(val.b), reg_of(val.c), val.p0, val.p1, val.gen});
+          // Released after dst is taken so an instruction never writes the register it reads
+          for (const uint32_t operand : {val.a, val.b, val.c}) {
+            if (operand == no_value || values[operand].op == opcode::input || values[operand].op == opcode::constant) {
+              continue;
+            }
+            if (last_use[operand] == v && std::find(free.begin(), free.end(), reg[operand]) == free.end()) {
+              free.push_back(reg[operand]);
+            }
+          }
+        }
+        result.result = reg[output];
+        result.register_count = count;
+      }
+    };
+  };
+
+  // Definition of the static member bound to references (reg_of, comparisons in lambdas), required before C++17
+  template<typename T>
+  const uint32_t basic_graph<T>::no_value;
+
+  using graph = basic_graph<double>;
+  using graphf = basic_graph<float>;
+  using program = basic_program<double>;
+  using programf = basic_program<float>;
+}
+
+#endif // GRAPH_H
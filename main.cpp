@@ -1,7 +1,11 @@
 #include <iostream>
 #include "noise.hpp"
+#include "pool.hpp"
+#include "animation.hpp"
+#include "color.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include <SDL2/SDL.h>
-#include <future>
 // OpenGL related headers
 #include <GL/glew.h>
 #include <SDL_opengl.h>
@@ -27,75 +31,40 @@ const int SEED = 1;
 /** */
 const double TIME_STEP = 0.01;
 
-struct Region {
-  const size_t nx, ny;
-  size_t x0, x1;
-  size_t y0, y1;
-};
-
-/// Semaphore
-struct Semaphore {
-private:
-  size_t value = 0;
-  std::mutex mut;
+/** Side of the square tiles the frame is split into */
+const size_t TILE_SIZE = 32;
+/** Reuses the coarse octaves between frames (pn::animated_fbm) instead of evaluating fbm for every pixel */
+const bool TEMPORAL_REUSE = true;
+/** Largest difference from fbm allowed by the temporal reuse */
+const double MAX_ERROR = 0.005;
+/** Trace timeline written at exit and on pressing T when built with PN_TRACE */
+const char* TRACE_FILE = "noise_trace.json";
+/** Display gamma of the gray ramp */
+const double GAMMA = 2.0;
 
-public:
-  explicit Semaphore(size_t val): value(val) {}
-  
-  void post(size_t val = 1) {
-    std::unique_lock<std::mutex> lk(mut);
-    value += val;
-  }
-  
-  size_t get_value() {
-    std::unique_lock<std::mutex> lk(mut);
-    return value;
-  }
-  
-  bool peek() {
-    std::unique_lock<std::mutex> lk(mut);
-    return value != 0;
-  }
-  
-  bool try_wait() {
-    std::unique_lock<std::mutex> lk(mut);
-    if (value == 0) {
-      return false;
-    } else {
-      value--;
-      return true;
+/// Draws the pixels [x0, x1) x [y0, y1) of a nx by ny frame
+void draw(size_t nx, size_t ny, size_t x0, size_t y0, size_t x1, size_t y1, double time, uint32_t* pixels,
+          const pn::generator& noise_gen, const pn::color_map& colors) {
+  for (size_t x = x0; x < x1; x++) {
+    for (size_t y = y0; y < y1; y++) {
+      // std::vector<double> amplitudes = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0};
+      // double noise = noise_gen.octaves(x, y, time, amplitudes);
+      // double noise = noise_gen.domain_wrapping(x, y, time, DIVISOR);
+      // double noise = noise_gen.turbulence_ridged(x, y, time, DIVISOR);
+      // double noise = noise_gen(x, y);
+      // double noise = noise_gen.turbulence(x, y, DIVISOR);
+      double noise = noise_gen.fbm(x, y, time, DIVISOR);
+      pixels[((ny - 1 - y) * nx) + x] = colors.rgba8(noise);
     }
   }
-};
+}
 
-void draw(Semaphore* qsem, Semaphore* sem, Region reg, const double* time, uint32_t* pixels, const pn::generator& noise_gen) {
-  while (qsem->peek()) {
-    std::this_thread::sleep_for(std::chrono::nanoseconds(100));
-    while (sem->try_wait()) {
-      for (size_t x = reg.x0; x <= reg.x1; x++) {
-        for (size_t y = reg.y0; y <= reg.y1; y++) {
-          // std::vector<double> amplitudes = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0};
-          // double noise = noise_gen.octaves(x, y, time, amplitudes);
-          // double noise = noise_gen.domain_wrapping(x, y, time, DIVISOR);
-          // double noise = noise_gen.turbulence_ridged(x, y, time, DIVISOR);
-          // double noise = noise_gen(x, y);
-          // double noise = noise_gen.turbulence(x, y, DIVISOR);
-          double noise = noise_gen.fbm(x, y, *time, DIVISOR);
-          double color = 0.5 + noise * 0.5;
-          color = std::sqrt(color); // Gamma-2 correction
-          auto ir = uint32_t(color * 255);
-          auto ig = uint32_t(color * 255);
-          auto ib = uint32_t(color * 255);
-          auto ia = uint32_t(1);
-          uint32_t pixel = 0;
-          pixel += (ia << (8 * 3));
-          pixel += (ir << (8 * 2));
-          pixel += (ig << (8 * 1));
-          pixel += (ib << (8 * 0));
-          pixels[((reg.ny - y) * reg.nx) + x] = pixel;
-        }
-      }
-    }
+/// Draws the rows [y0, y1) of the animated fbm field
+void draw_animated(size_t nx, size_t ny, size_t y0, size_t y1, double time, uint32_t* pixels, double* values,
+                   pn::animated_fbm& field, const pn::color_map& colors) {
+  field.evaluate(time, y0, y1, values);
+  for (size_t y = y0; y < y1; y++) {
+    colors.rgba8(values + y * nx, pixels + (ny - 1 - y) * nx, nx);
   }
 }
 
@@ -115,46 +84,55 @@ int main() {
   SDL_Surface* scr = SDL_GetWindowSurface(window);
   uint32_t* pixels = (uint32_t*) scr->pixels;
   
-  pn::simplex::patent noise(SEED);
+  // Continuous in 3D with a proven second_derivative, so animated_fbm can interpolate its octaves between keyframes
+  pn::perlin::improved<> noise(SEED);
   double time = 0.0;
   
-  const size_t num_threads = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
-  Semaphore sem{0};  // Signals the number thread workloads left for the current iteration
-  Semaphore qsem{1}; // Signals whether or not all work is done and the threads should terminate
-  std::vector<std::thread> threads{};
-  for (size_t i = 0; i < num_threads; i++) {
-    const size_t num_rows = ny / num_threads;
-    Region reg{nx, ny, 0, nx, i * num_rows, (i + 1) * num_rows};
-    threads.emplace_back(std::thread{draw, &qsem, &sem, reg, &time, pixels, noise});
-  }
+  pn::pool workers; // One worker per hardware thread
+  pn::animated_fbm field(noise, pn::grid2{0.0, 0.0, 1.0, 1.0, nx, ny}, DIVISOR, MAX_ERROR, TIME_STEP);
+  std::vector<double> values(nx * ny);
+  const pn::color_map colors(pn::color_map::gray(), -1.0, 1.0, GAMMA); // Same layout as the window surface
+  
+  pn::metrics::reporter report(std::cout); // Prints the frame and tile times once per second with PN_METRICS
+  pn::trace::set_thread_name("main");
+  pn::trace::write_at_exit(TRACE_FILE);
   
   SDL_Event event;
   bool quit = false;
   while (!quit) {
+    pn::trace::span frame("frame");
     while (SDL_PollEvent(&event)) {
         if (event.key.keysym.sym == SDLK_ESCAPE || event.type == SDL_QUIT) {
             quit = true;
             break;
         }
+        if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_t && pn::trace::write(TRACE_FILE)) {
+            std::cout << "trace written to " << TRACE_FILE << std::endl;
+        }
     }
     time += TIME_STEP;
     auto start = std::chrono::high_resolution_clock::now();
-    sem.post(num_threads); // Post work for the threads
-    while (!sem.peek()) {
-      std::this_thread::sleep_for(std::chrono::nanoseconds(10));
+    {
+      pn::trace::span render("render");
+      if (TEMPORAL_REUSE) {
+        workers.run_tiles(nx, ny, nx, TILE_SIZE, [&](size_t, size_t y0, size_t, size_t y1, size_t) {
+          draw_animated(nx, ny, y0, y1, time, pixels, values.data(), field, colors);
+        });
+      } else {
+        workers.run_tiles(nx, ny, TILE_SIZE, TILE_SIZE, [&](size_t x0, size_t y0, size_t x1, size_t y1, size_t) {
+          draw(nx, ny, x0, y0, x1, y1, time, pixels, noise, colors);
+        });
+      }
     }
     auto end = std::chrono::high_resolution_clock::now();
     auto diff = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-    std::cout << diff << " ns/frame" << std::endl;
-    SDL_UpdateWindowSurface(window);
-  }
-  // FIXME: Super slow closing time
-  // TODO: Add another semaphore for the number of completed work items/threads
-  while (!qsem.peek()) {} // Try to signal quit to all threads
-  for (auto& thread : threads) {
-    thread.join();
+    pn::metrics::record(pn::metrics::timer::frame, (uint64_t) diff);
+    {
+      pn::trace::span present("present");
+      SDL_UpdateWindowSurface(window);
+    }
+    report.tick();
   }
-  
   SDL_DestroyWindow(window);
   SDL_Quit();
   return EXIT_SUCCESS;
@@ -0,0 +1,354 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <iosfwd>
+
+/// Runtime metrics are compiled in with PN_METRICS, without it every hook below is an empty inline function
+#ifdef PN_METRICS
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <ostream>
+#endif
+
+namespace pn {
+  /**
+   * Opt-in runtime metrics of the generators and the render pool.
+   *
+   * Counters are kept per generator (a source, identified by the generator's name()): samples is the number of values
+   * asked for through the library (one per fractal call, one per point of a fill) and octaves the number of noise
+   * evaluations made to produce them. Raw operator() and batch() calls are not counted: they are the virtuals every
+   * generator overrides and the fractal calls go through them once per octave. Callers that evaluate raw noise point
+   * by point count it themselves with add(source_of(gen), counter::samples, n).
+   *
+   * Timers record a count, a sum and a log-linear histogram of durations in ns: tile is the compute time of a pool
+   * task, queue_wait the time a task waited between pool::run() and the start of its execution, frame whatever the
+   * application records as a frame (the explorer records the time of a rendered frame).
+   *
+   * Every thread writes to its own slot with relaxed loads and stores, no locks or read-modify-write instructions on
+   * the hot path. read() sums the slots into a snapshot, which may tear between counters but never within one.
+   */
+  namespace metrics {
+    /// Per source counters
+    enum class counter : int { samples, octaves, num };
+
+    /// Durations with histograms
+    enum class timer : int { tile, queue_wait, frame, num };
+
+    /// Largest number of distinct sources, later ones are counted under the last one
+    static const size_t max_sources = 32;
+
+    /// Histogram buckets, values below 4 ns get a bucket each, above that 4 buckets per power of two
+    static const size_t num_buckets = 256;
+
+    /// Bucket of a duration in ns
+    inline size_t bucket_of(const uint64_t ns) {
+      if (ns < 4) { return (size_t) ns; }
+      int e = 63;
+      while (!(ns >> e)) { e--; }
+      return (size_t) (4 * (e - 1) + ((ns >> (e - 2)) & 3));
+    }
+
+    /// Smallest duration in ns of a bucket
+    inline double bucket_floor(const size_t b) {
+      if (b < 4) { return (double) b; }
+      const int e = (int) b / 4 + 1;
+      return std::ldexp((double) (4 + b % 4), e - 2);
+    }
+
+    /// Count, sum and distribution of the durations recorded by a timer
+    struct histogram {
+      uint64_t count = 0;
+      uint64_t total_ns = 0;
+      uint64_t buckets[num_buckets] = {};
+
+      double mean() const { return count == 0 ? 0.0 : (double) total_ns / count; }
+
+      /// Duration in ns below which a fraction q of the recorded ones lie, the midpoint of the bucket it falls in
+      double quantile(const double q) const {
+        if (count == 0) { return 0.0; }
+        const double rank = q * count;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < num_buckets; b++) {
+          seen += buckets[b];
+          if (buckets[b] > 0 && seen >= rank) {
+            return b + 1 < num_buckets ? (bucket_floor(b) + bucket_floor(b + 1)) / 2 : bucket_floor(b);
+          }
+        }
+        return bucket_floor(num_buckets - 1);
+      }
+    };
+
+#ifdef PN_METRICS
+    static const bool enabled = true;
+
+    /// Counters and timers written by one thread
+    struct slot {
+      std::atomic<uint64_t> counts[max_sources][(int) counter::num];
+      std::atomic<uint64_t> timer_counts[(int) timer::num];
+      std::atomic<uint64_t> timer_totals[(int) timer::num];
+      std::atomic<uint64_t> buckets[(int) timer::num][num_buckets];
+      slot* next = nullptr;
+    };
+
+    /// Head of the list of every slot ever created, slots outlive their threads so no count is lost
+    inline std::atomic<slot*>& slots() {
+      static std::atomic<slot*> head{nullptr};
+      return head;
+    }
+
+    /// Slot of the calling thread, created and pushed on the slot list on first use
+    inline slot& local() {
+      thread_local slot* own = nullptr;
+      if (!own) {
+        own = new slot(); // Value initialized, every counter starts at 0
+        slot* head = slots().load();
+        do {
+          own->next = head;
+        } while (!slots().compare_exchange_weak(head, own));
+      }
+      return *own;
+    }
+
+    /// Adds to a counter only the calling thread writes, a plain load and store instead of a locked add
+    inline void bump(std::atomic<uint64_t>& value, const uint64_t n) {
+      value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct registry {
+      std::mutex mut;
+      std::vector<std::string> names;
+    };
+
+    inline registry& sources() {
+      static registry r;
+      return r;
+    }
+
+    /// Id of the source with the given name, registered on first use
+    inline size_t source(const char* name) {
+      // Generators are mostly asked for by the same thread over and over, skip the registry for a repeated name
+      thread_local const char* last_name = nullptr;
+      thread_local size_t last_id = 0;
+      if (name == last_name) { return last_id; }
+      registry& r = sources();
+      std::unique_lock<std::mutex> lk(r.mut);
+      size_t id = 0;
+      while (id < r.names.size() && r.names[id] != name) { id++; }
+      if (id == r.names.size()) {
+        if (id < max_sources) {
+          r.names.push_back(name);
+        } else {
+          id = max_sources - 1;
+        }
+      }
+      last_name = name;
+      last_id = id;
+      return id;
+    }
+
+    /**
+     * Source id kept by a generator, so the registry is only locked the first time the generator is counted. Copies
+     * keep the id, a copy has the same name.
+     */
+    class source_cache {
+    public:
+      source_cache() = default;
+      source_cache(const source_cache& other) : id(other.id.load(std::memory_order_relaxed)) {}
+      source_cache& operator=(const source_cache& other) {
+        id.store(other.id.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+      }
+
+      /// Id of the source with the given name, registered on the first call only; racing first calls agree on the id
+      size_t get(const char* name) const {
+        size_t value = id.load(std::memory_order_relaxed);
+        if (value == unset) {
+          value = source(name);
+          id.store(value, std::memory_order_relaxed);
+        }
+        return value;
+      }
+
+    private:
+      static const size_t unset = ~size_t(0);
+      mutable std::atomic<size_t> id{unset};
+    };
+
+    /// Source of a generator, cached by the generator, its name() is only looked at when metrics are compiled in
+    template<typename Gen>
+    inline size_t source_of(const Gen& gen) { return gen.metrics_source(); }
+
+    inline void add(const size_t source, const counter c, const uint64_t n = 1) {
+      bump(local().counts[source][(int) c], n);
+    }
+
+    inline void record(const timer t, const uint64_t ns) {
+      slot& s = local();
+      bump(s.timer_counts[(int) t], 1);
+      bump(s.timer_totals[(int) t], ns);
+      bump(s.buckets[(int) t][bucket_of(ns)], 1);
+    }
+
+    /// Monotonic time in ns for the timers
+    inline uint64_t now() {
+      return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+#else
+    static const bool enabled = false;
+
+    inline size_t source(const char*) { return 0; }
+
+    class source_cache {
+    public:
+      size_t get(const char*) const { return 0; }
+    };
+
+    template<typename Gen>
+    inline size_t source_of(const Gen&) { return 0; }
+    inline void add(const size_t, const counter, const uint64_t = 1) {}
+    inline void record(const timer, const uint64_t) {}
+    inline uint64_t now() { return 0; }
+#endif
+
+    /// Records the time from construction to destruction
+    class scoped_timer {
+    public:
+      explicit scoped_timer(const timer t) : t(t), start(now()) {}
+      ~scoped_timer() { record(t, now() - start); }
+
+      scoped_timer(const scoped_timer&) = delete;
+      scoped_timer& operator=(const scoped_timer&) = delete;
+
+    private:
+      timer t;
+      uint64_t start;
+    };
+
+    /// Sum of every thread's counters at one point in time
+    struct snapshot {
+      struct source_counts {
+        const char* name;
+        uint64_t counts[(int) counter::num];
+      };
+
+      source_counts sources[max_sources];
+      size_t num_sources = 0;
+      histogram timers[(int) timer::num];
+
+      uint64_t count(const size_t source, const counter c) const { return sources[source].counts[(int) c]; }
+      const histogram& operator[](const timer t) const { return timers[(int) t]; }
+
+      /// What was recorded between an earlier snapshot and this one
+      snapshot since(const snapshot& earlier) const {
+        snapshot d = *this;
+        for (size_t i = 0; i < earlier.num_sources; i++) {
+          for (int c = 0; c < (int) counter::num; c++) { d.sources[i].counts[c] -= earlier.sources[i].counts[c]; }
+        }
+        for (int t = 0; t < (int) timer::num; t++) {
+          d.timers[t].count -= earlier.timers[t].count;
+          d.timers[t].total_ns -= earlier.timers[t].total_ns;
+          for (size_t b = 0; b < num_buckets; b++) { d.timers[t].buckets[b] -= earlier.timers[t].buckets[b]; }
+        }
+        return d;
+      }
+    };
+
+#ifdef PN_METRICS
+    /// Sums the slots of every thread
+    inline snapshot read() {
+      snapshot s;
+      {
+        registry& r = sources();
+        std::unique_lock<std::mutex> lk(r.mut);
+        s.num_sources = r.names.size();
+        for (size_t i = 0; i < s.num_sources; i++) {
+          s.sources[i].name = r.names[i].c_str(); // Names are never removed, the pointer stays valid
+        }
+      }
+      for (size_t i = 0; i < s.num_sources; i++) {
+        for (int c = 0; c < (int) counter::num; c++) { s.sources[i].counts[c] = 0; }
+      }
+      for (const slot* t = slots().load(); t; t = t->next) {
+        for (size_t i = 0; i < s.num_sources; i++) {
+          for (int c = 0; c < (int) counter::num; c++) {
+            s.sources[i].counts[c] += t->counts[i][c].load(std::memory_order_relaxed);
+          }
+        }
+        for (int k = 0; k < (int) timer::num; k++) {
+          histogram& h = s.timers[k];
+          h.count += t->timer_counts[k].load(std::memory_order_relaxed);
+          h.total_ns += t->timer_totals[k].load(std::memory_order_relaxed);
+          for (size_t b = 0; b < num_buckets; b++) { h.buckets[b] += t->buckets[k][b].load(std::memory_order_relaxed); }
+        }
+      }
+      return s;
+    }
+
+    /// Prints one line per timer (count, mean, p50, p99 in ms) and per source
+    inline void dump(std::ostream& out, const snapshot& s) {
+      static const char* timer_names[] = {"tile", "queue_wait", "frame"};
+      char line[160];
+      for (int t = 0; t < (int) timer::num; t++) {
+        const histogram& h = s.timers[t];
+        if (h.count == 0) { continue; }
+        std::snprintf(line, sizeof(line), "%-12s %10llu x  mean %9.3f ms  p50 %9.3f ms  p99 %9.3f ms\n",
+                      timer_names[t], (unsigned long long) h.count, h.mean() * 1e-6, h.quantile(0.5) * 1e-6,
+                      h.quantile(0.99) * 1e-6);
+        out << line;
+      }
+      for (size_t i = 0; i < s.num_sources; i++) {
+        const uint64_t samples = s.count(i, counter::samples);
+        const uint64_t octaves = s.count(i, counter::octaves);
+        if (samples == 0 && octaves == 0) { continue; }
+        std::snprintf(line, sizeof(line), "%-26s %14llu samples %14llu octaves\n", s.sources[i].name,
+                      (unsigned long long) samples, (unsigned long long) octaves);
+        out << line;
+      }
+    }
+#else
+    inline snapshot read() { return snapshot{}; }
+    inline void dump(std::ostream&, const snapshot&) {}
+#endif
+
+#ifdef PN_METRICS
+    /// Dumps what was recorded since the previous dump, at most once per interval
+    class reporter {
+    public:
+      explicit reporter(std::ostream& out, const double interval_seconds = 1.0) :
+        out(out), interval_ns((uint64_t) (interval_seconds * 1e9)), last_time(now()), last(read()) {}
+
+      /// Cheap to call every frame, only reads the slots once the interval has passed
+      void tick() {
+        const uint64_t t = now();
+        if (t - last_time < interval_ns) { return; }
+        const snapshot s = read();
+        dump(out, s.since(last));
+        last = s;
+        last_time = t;
+      }
+
+    private:
+      std::ostream& out;
+      uint64_t interval_ns;
+      uint64_t last_time;
+      snapshot last;
+    };
+#else
+    class reporter {
+    public:
+      explicit reporter(std::ostream&, const double = 1.0) {}
+      void tick() {}
+    };
+#endif
+  }
+}
+
+#endif // METRICS_H
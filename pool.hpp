@@ -0,0 +1,177 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <string>
+#include "metrics.hpp"
+#include "trace.hpp"
+
+namespace pn {
+  /**
+   * Work-stealing thread pool for tiled workloads.
+   *
+   * Each call to run() is one frame: the tasks [0, num_tasks) are dealt out in contiguous runs to per-worker deques.
+   * Workers pop tasks from the front of their own deque and, once it runs dry, steal from the back of the others, so
+   * uneven tiles (e.g. domain wrapping next to plain fbm) do not leave threads idle. The calling thread blocks on a
+   * completion barrier until every task of the frame has finished; idle workers block on a condition variable.
+   *
+   * run() must not be called from inside a task and the pool is meant to be driven by a single thread.
+   *
+   * With PN_METRICS every task records its compute time (metrics::timer::tile) and how long it waited since run()
+   * was called (metrics::timer::queue_wait). With PN_TRACE tasks, idle workers and run() waiting for the frame show up
+   * as "tile", "idle" and "wait" spans of the trace timeline.
+   */
+  class pool {
+  public:
+    /// Task callback, receives the task index and the index of the worker running it
+    using task = std::function<void(size_t task, size_t worker)>;
+
+    /// Starts num_workers threads, 0 uses the hardware concurrency
+    explicit pool(size_t num_workers = 0) {
+      if (num_workers == 0) {
+        num_workers = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+      }
+      for (size_t i = 0; i < num_workers; i++) {
+        queues.emplace_back(new queue{});
+      }
+      for (size_t i = 0; i < num_workers; i++) {
+        threads.emplace_back(&pool::work, this, i);
+      }
+    }
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
+
+    ~pool() {
+      {
+        std::unique_lock<std::mutex> lk(mut);
+        quit = true;
+      }
+      work_cv.notify_all();
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+
+    /// Number of worker threads
+    size_t size() const { return threads.size(); }
+
+    /// Runs fn for every task in [0, num_tasks) and returns once all of them are done
+    void run(size_t num_tasks, const task& fn) {
+      if (num_tasks == 0) { return; }
+      job = &fn;
+      frame_start = metrics::now();
+      remaining.store(num_tasks);
+      const size_t num_workers = queues.size();
+      for (size_t w = 0; w < num_workers; w++) {
+        const size_t begin = num_tasks * w / num_workers;
+        const size_t end = num_tasks * (w + 1) / num_workers;
+        std::unique_lock<std::mutex> lk(queues[w]->mut);
+        for (size_t t = begin; t < end; t++) {
+          queues[w]->tasks.push_back(t);
+        }
+      }
+      trace::span wait("wait");
+      std::unique_lock<std::mutex> lk(mut);
+      generation++;
+      work_cv.notify_all();
+      done_cv.wait(lk, [this]() { return remaining.load() == 0; });
+    }
+
+    /**
+     * Splits a width x height image into tiles of tile_width x tile_height and runs fn(x0, y0, x1, y1, worker) for
+     * each one, the ranges are half-open [x0, x1) x [y0, y1).
+     */
+    template<typename Fn>
+    void run_tiles(size_t width, size_t height, size_t tile_width, size_t tile_height, const Fn& fn) {
+      tile_width = std::max<size_t>(1, tile_width);
+      tile_height = std::max<size_t>(1, tile_height);
+      const size_t tiles_x = (width + tile_width - 1) / tile_width;
+      const size_t tiles_y = (height + tile_height - 1) / tile_height;
+      run(tiles_x * tiles_y, [&](size_t t, size_t worker) {
+        const size_t x0 = (t % tiles_x) * tile_width;
+        const size_t y0 = (t / tiles_x) * tile_height;
+        fn(x0, y0, std::min(x0 + tile_width, width), std::min(y0 + tile_height, height), worker);
+      });
+    }
+
+  private:
+    struct queue {
+      std::mutex mut;
+      std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex mut;
+    std::condition_variable work_cv; // Signals a new frame or shutdown to the workers
+    std::condition_variable done_cv; // Signals the end of the frame to run()
+    const task* job = nullptr;
+    std::atomic<size_t> remaining{0};
+    uint64_t frame_start = 0; // metrics::now() when run() was called, the queue wait of a task is measured from it
+    size_t generation = 0;
+    bool quit = false;
+
+    /// Pops a task from the front of the own deque or steals one from the back of another worker's deque
+    bool next(size_t worker, size_t& t) {
+      {
+        queue& own = *queues[worker];
+        std::unique_lock<std::mutex> lk(own.mut);
+        if (!own.tasks.empty()) {
+          t = own.tasks.front();
+          own.tasks.pop_front();
+          return true;
+        }
+      }
+      for (size_t i = 1; i < queues.size(); i++) {
+        queue& victim = *queues[(worker + i) % queues.size()];
+        std::unique_lock<std::mutex> lk(victim.mut);
+        if (!victim.tasks.empty()) {
+          t = victim.tasks.back();
+          victim.tasks.pop_back();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void work(size_t worker) {
+      if (trace::enabled) { trace::set_thread_name(("worker " + std::to_string(worker)).c_str()); }
+      size_t seen = 0;
+      while (true) {
+        {
+          trace::span idle("idle");
+          std::unique_lock<std::mutex> lk(mut);
+          work_cv.wait(lk, [&]() { return quit || generation != seen; });
+          if (quit) { return; }
+          seen = generation;
+        }
+        size_t t;
+        while (next(worker, t)) {
+          const uint64_t start = metrics::now();
+          metrics::record(metrics::timer::queue_wait, start - frame_start);
+          {
+            trace::span tile("tile");
+            (*job)(t, worker);
+          }
+          metrics::record(metrics::timer::tile, metrics::now() - start);
+          if (remaining.fetch_sub(1) == 1) {
+            // Last task of the frame, take the lock so the notification cannot slip in before run() waits
+            std::unique_lock<std::mutex> lk(mut);
+            done_cv.notify_all();
+          }
+        }
+      }
+    }
+  };
+}
+
+#endif // POOL_H
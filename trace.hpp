@@ -0,0 +1,181 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iosfwd>
+
+/// Trace spans are compiled in with PN_TRACE, without it a span is an empty object and nothing is recorded
+#ifdef PN_TRACE
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <ostream>
+#include <fstream>
+#endif
+
+namespace pn {
+  /**
+   * Opt-in timeline of named spans, exported as Chrome Trace Event JSON (chrome://tracing, Perfetto).
+   *
+   * A span records its begin and end time when it goes out of scope into a ring buffer owned by the calling thread,
+   * so recording takes no locks and only the last ring_size spans of each thread are kept. write() can run while
+   * other threads keep recording, spans overwritten during the export are left out. Span names must outlive the
+   * export, string literals are the intended use.
+   *
+   * The pool records "tile" spans for its tasks, "idle" while a worker waits for work and "wait" while run() waits
+   * for the end of the frame.
+   */
+  namespace trace {
+    /// Spans kept per thread
+    static const size_t ring_size = 1 << 15;
+
+#ifdef PN_TRACE
+    static const bool enabled = true;
+
+    /// Time in ns since the first call, shared by all threads
+    inline uint64_t now() {
+      static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+      return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    /// Spans of one thread, written by that thread only
+    struct ring {
+      struct entry {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> begin;
+        std::atomic<uint64_t> end;
+      };
+
+      entry entries[ring_size];
+      std::atomic<uint64_t> count; // Spans ever recorded, the next one goes to entries[count % ring_size]
+      size_t id = 0;
+      char name[32];
+      ring* next = nullptr;
+    };
+
+    /// Head of the list of every ring ever created, rings outlive their threads so their spans can still be exported
+    inline std::atomic<ring*>& rings() {
+      static std::atomic<ring*> head{nullptr};
+      return head;
+    }
+
+    /// Ring of the calling thread, created and pushed on the ring list on first use
+    inline ring& local() {
+      static std::atomic<size_t> next_id{0};
+      thread_local ring* own = nullptr;
+      if (!own) {
+        own = new ring(); // Value initialized, no spans and an empty name
+        own->id = next_id.fetch_add(1) + 1;
+        ring* head = rings().load();
+        do {
+          own->next = head;
+        } while (!rings().compare_exchange_weak(head, own));
+      }
+      return *own;
+    }
+
+    /// Names the calling thread in the exported timeline
+    inline void set_thread_name(const char* name) {
+      ring& r = local();
+      std::strncpy(r.name, name, sizeof(r.name) - 1);
+    }
+
+    /// Records a span that started at begin and ends now
+    inline void record(const char* name, const uint64_t begin) {
+      ring& r = local();
+      const uint64_t end = now();
+      const uint64_t n = r.count.load(std::memory_order_relaxed);
+      ring::entry& e = r.entries[n % ring_size];
+      e.name.store(name, std::memory_order_relaxed);
+      e.begin.store(begin, std::memory_order_relaxed);
+      e.end.store(end, std::memory_order_relaxed);
+      r.count.store(n + 1, std::memory_order_release);
+    }
+
+    /// Writes the spans of every thread as a Chrome Trace Event JSON object
+    inline void write(std::ostream& out) {
+      char line[256];
+      bool first = true;
+      out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+      for (const ring* r = rings().load(); r; r = r->next) {
+        if (r->name[0] != '\0') {
+          std::snprintf(line, sizeof(line), "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, "
+                        "\"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", r->id, r->name);
+          out << line;
+          first = false;
+        }
+        const uint64_t count = r->count.load(std::memory_order_acquire);
+        const uint64_t oldest = count > ring_size ? count - ring_size : 0;
+        for (uint64_t n = oldest; n < count; n++) {
+          const ring::entry& e = r->entries[n % ring_size];
+          const char* name = e.name.load(std::memory_order_relaxed);
+          const uint64_t begin = e.begin.load(std::memory_order_relaxed);
+          const uint64_t end = e.end.load(std::memory_order_relaxed);
+          // The owner may have wrapped around onto this entry while it was read
+          const uint64_t now_count = r->count.load(std::memory_order_acquire);
+          if (now_count > ring_size && n < now_count - ring_size) { continue; }
+          std::snprintf(line, sizeof(line), "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, "
+                        "\"ts\": %.3f, \"dur\": %.3f}", first ? "" : ",\n", name, r->id, begin * 1e-3,
+                        (end - begin) * 1e-3);
+          out << line;
+          first = false;
+        }
+      }
+      out << "\n]}\n";
+    }
+
+    /// Writes the trace to a file, false if it cannot be opened
+    inline bool write(const std::string& path) {
+      std::ofstream out(path);
+      if (!out) { return false; }
+      write(out);
+      return out.good();
+    }
+
+    /// Writes the trace to path when the program exits normally, a later call replaces the path
+    inline void write_at_exit(const std::string& path) {
+      static std::string exit_path;
+      static bool registered = false;
+      exit_path = path;
+      if (!registered) {
+        registered = true;
+        std::atexit([]() { write(exit_path); });
+      }
+    }
+
+    /// Records the time from construction to destruction under a name
+    class span {
+    public:
+      explicit span(const char* name) : name(name), begin(now()) {}
+      ~span() { record(name, begin); }
+
+      span(const span&) = delete;
+      span& operator=(const span&) = delete;
+
+    private:
+      const char* name;
+      uint64_t begin;
+    };
+#else
+    static const bool enabled = false;
+
+    inline void set_thread_name(const char*) {}
+    inline void write(std::ostream&) {}
+    template<typename Path>
+    inline bool write(const Path&) { return false; }
+    template<typename Path>
+    inline void write_at_exit(const Path&) {}
+
+    class span {
+    public:
+      explicit span(const char*) {}
+    };
+#endif
+  }
+}
+
+#endif // TRACE_H